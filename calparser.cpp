@@ -109,6 +109,39 @@ bool calParser::saveCalDataToFile(QList<magPhaseCalData> data, QString file)
 	return true;
 }
 
+bool calParser::saveCalDataToFile(settlingCalData data, QString file)
+{
+	if(file.isEmpty())
+		file = getConfigLocation() + QDir::separator() + STANDARD_SETTLING_CAL_FILENAME;
+	QFileInfo inf(file);
+	QDir dir(inf.absolutePath());
+	if (!dir.exists())
+		dir.mkpath(inf.absolutePath());
+
+	QFile f(file);
+	if(!f.open(QIODevice::WriteOnly | QIODevice::Truncate))
+		return false;
+	QJsonObject obj;
+	obj["CalDate"] = data.calDate;
+	obj["Type"] = "Settling Calibration";
+	obj["Minimum(us)"] = data.minimum_us;
+	obj["PLL(us/MHz)"] = data.PLL_us_per_MHz;
+	QJsonArray talks;
+	QList<double> keys = data.jumpToSettle.keys();
+	std::sort(keys.begin(), keys.end());
+	foreach(double key, keys)
+	{
+		QJsonObject o;
+		o["Jump(MHz)"] = key;
+		o["Settle(us)"] = data.jumpToSettle.value(key);
+		talks.append(o);
+	}
+	obj["SettleTable"] = talks;
+	f.write(QJsonDocument(obj).toJson(QJsonDocument::Indented));
+	f.close();
+	return true;
+}
+
 bool calParser::createDefaultFreqCalData(QString file)
 {
 	if(file.isEmpty())
@@ -224,6 +257,45 @@ QList<calParser::magPhaseCalData> calParser::loadMagPhaseCalDataFromFile(QString
 	return  ret;
 }
 
+calParser::settlingCalData calParser::loadSettlingCalDataFromFile(QString file, bool &success, QString &errorText)
+{
+	if(file.isEmpty())
+		file = getConfigLocation() + QDir::separator() + STANDARD_SETTLING_CAL_FILENAME;
+	success = true;
+	calParser::settlingCalData ret;
+	ret.minimum_us = 0;
+	ret.PLL_us_per_MHz = 0;
+	QFile f(file);
+	if(!f.open(QIODevice::ReadOnly)) {
+		errorText = "Could not open settling calibration file";
+		success = false;
+		return ret;
+	}
+	QJsonParseError jerror;
+	QJsonDocument jdoc= QJsonDocument::fromJson(f.readAll(),&jerror);
+	if(jerror.error != QJsonParseError::NoError) {
+		errorText = "Settling calibration file parsing error";
+		success = false;
+		return ret;
+	}
+	QJsonObject obj = jdoc.object();
+	if(obj["Type"] != "Settling Calibration") {
+		errorText = "Not a settling calibration file";
+		success = false;
+		return ret;
+	}
+	ret.calDate = obj["CalDate"].toString();
+	ret.minimum_us = obj["Minimum(us)"].toDouble();
+	ret.PLL_us_per_MHz = obj["PLL(us/MHz)"].toDouble();
+	QJsonArray values = obj["SettleTable"].toArray();
+	foreach(QJsonValue val, values)
+	{
+		const QJsonObject& o = val.toObject();
+		ret.jumpToSettle.insert(o["Jump(MHz)"].toDouble(), o["Settle(us)"].toDouble());
+	}
+	return  ret;
+}
+
 calParser::freqCalData calParser::importFreqCalFromOriginalSW(QString file, bool &success)
 {
 	success = true;
@@ -37,6 +37,7 @@
 
 #define STANDARD_FREQ_CAL_FILENAME "FrequencyCalibration.json"
 #define STANDARD_PATHS_CAL_FILENAME "PathsCalibration.json"
+#define STANDARD_SETTLING_CAL_FILENAME "SettlingCalibration.json"
 
 class calParser : public QObject
 {
@@ -62,12 +63,20 @@ public:
 		double calFrequency;
 		QHash<uint, magCalFactors> adcToMagCalFactors;
 	}magPhaseCalData;
+	typedef struct {
+		QString calDate;
+		double minimum_us; // fitted settle time = minimum_us + PLL_us_per_MHz * LO jump
+		double PLL_us_per_MHz;
+		QHash<double, double> jumpToSettle; // measured LO jump(MHz) to settle time(us)
+	}settlingCalData;
 	bool saveCalDataToFile(freqCalData data, QString file);
 	bool saveCalDataToFile(QList<magPhaseCalData> data, QString file);
+	bool saveCalDataToFile(settlingCalData data, QString file);
 	bool createDefaultFreqCalData(QString file = "");
 	bool createDefaultMagPhaseCalData(QString file = "");
 	freqCalData loadFreqCalDataFromFile(QString file, bool &success, QString &errorText);
 	QList<magPhaseCalData> loadMagPhaseCalDataFromFile(QString file, bool &success, QString &errorText);
+	settlingCalData loadSettlingCalDataFromFile(QString file, bool &success, QString &errorText);
 	freqCalData importFreqCalFromOriginalSW(QString file, bool &success);
 	magPhaseCalData importMagPhaseCalFromOriginalSW(QString file, bool &success);
 	QString getConfigLocation();
@@ -34,20 +34,7 @@ ad9850::ad9850(msa::MSAdevice device, QObject *parent) : genericDDS(parent)
 	//(Serial load Power-Down Sequence)WCLK up,WCLK up and FQUD up,WCLK up and FQUD down,WCLK down
 	//(Serial load enable Sequence)WCLK up, WCLK down, FQUD up, FQUD down
 	//(flush and command DDS1)D7,WCLK up,WCLK down,(repeat39more),FQUD up,FQUD down
-	QList<int> bits;
-	//bit numbering follows ADF4118 datasheet, LMX2326 is inverted
-	for(int x = 0; x < 32; ++x)
-		bits << x;
-	fillField(FIELD_FREQUENCY, bits, &deviceRegister);
-	bits.clear();
-	bits << 32 << 33;
-	fillField(FIELD_CONTROL, bits, &deviceRegister);
-	bits.clear();
-	bits << 34;
-	fillField(FIELD_POWER, bits, &deviceRegister);
-	bits.clear();
-	bits << 35 << 36 << 37 << 38 << 39;
-	fillField(FIELD_PHASE, bits, &deviceRegister);
+	deviceRegister = 0;
 	devicePin *pin = new devicePin;
 	pin->name = "Data";
 	pin->IOtype = hardwareDevice::MAIN_DATA;
@@ -65,34 +52,31 @@ ad9850::ad9850(msa::MSAdevice device, QObject *parent) : genericDDS(parent)
 	devicePins.insert(PIN_VIRTUAL_CLOCK, pin);
 }
 
-bool ad9850::processNewScan()
+void ad9850::prepareScan(quint32 steps, const msa::scanSnapshot &scan)
+{
+	genericDDS::prepareScan(steps, scan);
+}
+
+bool ad9850::processStepRange(quint32 first, quint32 last, quint32 slot)
 {
-	bool error; //TODO CHECK ERRORS
 	bool fataError;
-	bool hadErrors = false;
-	QList<quint32> steps = msa::getInstance().currentScan.steps->keys();
-	std::sort(steps.begin(), steps.end());
-	foreach (quint32 step, steps) {
-        if(initIndexes.contains(step))
-            continue;
-		quint32 base = parser->parseDDSOutput(msa::getInstance().currentScan.configuration, step, error,fataError);
-		//qDebug()<<"DDS:" << "step:"<<step<<" "<< base;
-		if(!error) {
-			setFieldRegister(FIELD_FREQUENCY, base);
-			registerToBuffer(&deviceRegister, PIN_DATA, step);
-			if(parser->getDevice() == msa::DDS1 && msa::getInstance().currentInterface->getDebugLevel() > 2) {
-				qDebug() << "DDS1 step:" << step  << " base:"<<base<<" array" << convertToStr(&deviceRegister);
-			}
-			config[step] = deviceRegister;
-		}
-		else {
-			hadErrors = true;
+	quint32 count = last - first;
+	QVector<quint32> base(int(count));
+	QVector<bool> valid(int(count));
+	bool hadErrors = parser->parseDDSRange(snapshot->configuration, first, last, slot, base.data(), ddsout.data() + slot, valid.data(), fataError);
+	// control, power and phase stay the same for the whole scan
+	const quint64 fixedFields = deviceRegister & ~FIELD_FREQUENCY::mask();
+	bool debug = (parser->getDevice() == msa::DDS1) && (getInstrument().currentInterface->getDebugLevel() > 2);
+	for (quint32 i = 0; i < count; ++i) {
+		// a step outside the DDS filter is not programmed, planValidator already rejected the scan
+		if(!valid.at(int(i)))
+			continue;
+		quint64 reg = fixedFields | FIELD_FREQUENCY::encode(base.at(int(i)));
+		if(debug) {
+			qDebug() << "DDS1 step:" << first + i  << " base:"<<base.at(int(i))<<" array" << convertToStr(reg, registerFields());
 		}
+		stepRegisters[int(slot + i)] = reg;
 	}
-//	foreach(int x, devicePins.value(PIN_DATA)->data.keys()) {
-//		QBitArray *arr = devicePins.value(PIN_DATA)->data.value(x).dataArray;
-//		////qDebug() << "ad9850" << getDDSOutput(x) << *arr;
-//	}
 	return hadErrors;
 }
 
@@ -129,32 +113,12 @@ void ad9850::reinit()
 
 }
 
-bool ad9850::checkSettings()
-{
-	return true;
-}
-
-void ad9850::registerToBuffer(quint64 *reg, int pin, quint32 step)
-{
-	if(!devicePins.value(pin)->data.contains(step))
-		devicePins.value(pin)->data.insert(step, createPinData(registerSize));
-	QBitArray * arrayData = devicePins.value(pin)->data.value(step).dataArray;
-	QBitArray * arrayMask = devicePins.value(pin)->data.value(step).dataMask;
-	arrayData->clear();
-	arrayData->resize(registerSize);
-	arrayMask->clear();
-	arrayMask->resize(registerSize);
-	quint64 r = *reg;
-	for(int x = 0; x < registerSize; ++ x) {
-		(*arrayMask)[x] = 1;
-		(*arrayData)[x] = r & static_cast<quint64>(1);
-		r = r >> 1;
-	}
-}
-
 QHash<quint64, quint64> ad9850::getConfig() const
 {
-	return config;
+	QHash<quint64, quint64> ret;
+	for(int step = 0; step < stepRegisters.size(); ++step)
+		ret.insert(quint64(step), stepRegisters.at(step));
+	return ret;
 }
 
 hardwareDevice::clockType ad9850::getClk_type() const
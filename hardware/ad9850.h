@@ -39,20 +39,25 @@ class ad9850 : public genericDDS
 	Q_OBJECT
 public:
 	explicit ad9850(msa::MSAdevice device, QObject *parent = 0);
-	bool processNewScan();
+	void prepareScan(quint32 steps, const msa::scanSnapshot &scan);
+	bool processStepRange(quint32 first, quint32 last, quint32 slot);
 	bool init();
 	void reinit();
 	// gets the type of CLK this device needs, dedicated or system wide
 	clockType getClk_type() const;
+	// the frequency word is shifted out LSB first
+	bitOrder getBitOrder() const {return LSB_FIRST;}
 	typedef enum {PIN_DATA, PIN_FQUD, PIN_WCLK, PIN_VIRTUAL_CLOCK} pins;
 	QHash<quint64, quint64> getConfig() const;
 
 private:
-	typedef enum {FIELD_FREQUENCY, FIELD_CONTROL, FIELD_POWER, FIELD_PHASE} fields_type;
-	bool checkSettings();
+	// the 40 bit register, frequency word first as it is shifted out LSB first
+	typedef registerField<0, 32> FIELD_FREQUENCY;
+	typedef registerField<32, 2> FIELD_CONTROL;
+	typedef registerField<34, 1> FIELD_POWER;
+	typedef registerField<35, 5> FIELD_PHASE;
+	static constexpr quint64 registerFields() {return FIELD_FREQUENCY::end() | FIELD_CONTROL::end() | FIELD_POWER::end();}
 	quint64 deviceRegister;
-	void registerToBuffer(quint64 *reg, int pin, quint32 step);
-	QHash<quint64, quint64> config;
 signals:
 
 public slots:
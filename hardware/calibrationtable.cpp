@@ -0,0 +1,108 @@
+/**
+ ******************************************************************************
+ *
+ * @file       main.cpp
+ * @author     Jose Barros (AKA PT_Dreamer) josemanuelbarros@gmail.com 2019
+ * @brief      calibrationtable.cpp file
+ * @see        The GNU Public License (GPL) Version 3
+ * @defgroup   calibrationTable
+ * @{
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+#include "calibrationtable.h"
+#include <algorithm>
+#include <cmath>
+
+// scale of the fixed point entries
+#define FIXED_POINT_SCALE 100.0
+
+calibrationTable::calibrationTable()
+{
+}
+
+void calibrationTable::build(const QHash<uint, calParser::magCalFactors> &points)
+{
+	if(points.isEmpty()) {
+		entries.clear();
+		return;
+	}
+	// a new table, the one in use may still be shared with a scan snapshot
+	QVector<entry> table(CALIBRATION_TABLE_SIZE);
+	entry *e = table.data();
+	QList<uint> keys = points.keys();
+	std::sort(keys.begin(), keys.end());
+	QVector<calParser::magCalFactors> values;
+	values.reserve(keys.size());
+	foreach (uint key, keys)
+		values.append(points.value(key));
+	// keys.at(y) is the first point at or above the code being filled
+	int y = 0;
+	for(quint32 x = 0; x < CALIBRATION_TABLE_SIZE; ++x) {
+		while((y < keys.size()) && (keys.at(y) < x))
+			++y;
+		if(y == keys.size()) {
+			e[x] = toEntry(values.last().dbm_val, values.last().phase_val);
+			continue;
+		}
+		const calParser::magCalFactors &above = values.at(y);
+		if((y == 0) || (keys.at(y) == x)) {
+			e[x] = toEntry(above.dbm_val, above.phase_val);
+			continue;
+		}
+		const calParser::magCalFactors &below = values.at(y - 1);
+		double fraction = double(keys.at(y) - x) / double(keys.at(y) - keys.at(y - 1));
+		e[x] = toEntry(above.dbm_val - fraction * (above.dbm_val - below.dbm_val),
+					   above.phase_val - fraction * (above.phase_val - below.phase_val));
+	}
+	entries = table;
+}
+
+calibrationTable::entry calibrationTable::toEntry(double dbm, double phase)
+{
+	entry e;
+#ifdef CALIBRATION_FIXED_POINT
+	e.dbm = qint16(qBound(-32768.0, std::round(dbm * FIXED_POINT_SCALE), 32767.0));
+	// only +-327.67 degrees fit, the phase is brought to +-180 first
+	e.phase = qint16(std::round(std::remainder(phase, 360.0) * FIXED_POINT_SCALE));
+#else
+	e.dbm = float(dbm);
+	e.phase = float(phase);
+#endif
+	return e;
+}
+
+double calibrationTable::magnitude(quint32 adc) const
+{
+	if(entries.isEmpty())
+		return 0;
+#ifdef CALIBRATION_FIXED_POINT
+	return at(adc).dbm / FIXED_POINT_SCALE;
+#else
+	return double(at(adc).dbm);
+#endif
+}
+
+double calibrationTable::phase(quint32 adc) const
+{
+	if(entries.isEmpty())
+		return 0;
+#ifdef CALIBRATION_FIXED_POINT
+	return at(adc).phase / FIXED_POINT_SCALE;
+#else
+	return double(at(adc).phase);
+#endif
+}
@@ -0,0 +1,66 @@
+/**
+ ******************************************************************************
+ *
+ * @file       main.cpp
+ * @author     Jose Barros (AKA PT_Dreamer) josemanuelbarros@gmail.com 2019
+ * @brief      calibrationtable.h file
+ * @see        The GNU Public License (GPL) Version 3
+ * @defgroup   calibrationTable
+ * @{
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef CALIBRATIONTABLE_H
+#define CALIBRATIONTABLE_H
+
+#include <QVector>
+#include "calparser.h"
+
+// one entry per code of the 16 bit magnitude ADC
+#define CALIBRATION_TABLE_SIZE 65536
+
+// Path calibration expanded to every ADC code, so a sample is converted with
+// one array access. Built once per path with a single pass over the sorted
+// calibration points, linearly interpolated between them and held at the
+// first and last point outside. Entries are floats (512KB), or 1/100 dB and
+// 1/100 degree integers (256KB) when built with CALIBRATION_FIXED_POINT, the
+// phases are then returned within +-180 degrees.
+class calibrationTable
+{
+public:
+	calibrationTable();
+	// no points (or not built) gives 0 for every code
+	void build(const QHash<uint, calParser::magCalFactors> &points);
+	double magnitude(quint32 adc) const;
+	double phase(quint32 adc) const;
+private:
+#ifdef CALIBRATION_FIXED_POINT
+	typedef struct {
+		qint16 dbm;
+		qint16 phase;
+	} entry;
+#else
+	typedef struct {
+		float dbm;
+		float phase;
+	} entry;
+#endif
+	static entry toEntry(double dbm, double phase);
+	const entry &at(quint32 adc) const {return entries.at(int(qMin(adc, quint32(CALIBRATION_TABLE_SIZE - 1))));}
+	QVector<entry> entries;
+};
+
+#endif // CALIBRATIONTABLE_H
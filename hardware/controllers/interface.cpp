@@ -30,23 +30,40 @@
 #include "../ad9850.h"
 #include "../genericadc.h"
 #include "../msa.h"
+#include "../scanplan.h"
+#include "../planstream.h"
 #include <QMessageBox>
+#include <QMetaMethod>
+#include <climits>
 
-interface::interface(QObject *parent):QThread(parent)
+interface::interface(QObject *parent, msa *instrument):QThread(parent), instrument(instrument ? instrument : &msa::getInstance()),
+	active(nullptr), staged(nullptr), wakeupPending(0), wakeupChunk(SAMPLE_WAKEUP_CHUNK), sinceWakeup(0), lastWakeup_ns(0),
+	commandsPosted(0), commandsDone(0), acquiring(false), replanResult(false), calibrationTolerance(0), stopRequested(0)
 {
+	sampleClock.start();
+	buffers[0] = buffers[1] = nullptr;
+	currentStep = 0;
+	numberOfSteps = 0;
+	sweepInverted = false;
+	sweepNumber = 0;
+	for(int x = 0; x < SWEEP_SNAPSHOTS; ++x)
+		snapshotSweeps[x] = 0;
 	//TODO delete this?
-	msa::getInstance().currentScan.configuration.LO2 = 1024;
-	msa::getInstance().currentScan.configuration.appxdds1 = 10.7;
-	msa::getInstance().currentScan.configuration.baseFrequency = 0;
-	msa::getInstance().currentScan.configuration.PLL1phasefreq = 0.974;
-	msa::getInstance().currentScan.configuration.pathCalibration.centerFreq_MHZ = 10.7;
-	msa::getInstance().currentScan.configuration.masterOscilatorFrequency = 64;
+	getInstrument().currentScan.configuration.LO2 = 1024;
+	getInstrument().currentScan.configuration.appxdds1 = 10.7;
+	getInstrument().currentScan.configuration.baseFrequency = 0;
+	getInstrument().currentScan.configuration.PLL1phasefreq = 0.974;
+	getInstrument().currentScan.configuration.pathCalibration.centerFreq_MHZ = 10.7;
+	getInstrument().currentScan.configuration.masterOscilatorFrequency = 64;
 	currentStatus = status_halted;
 }
 
 interface::~interface()
 {
-	foreach (hardwareDevice *dev, msa::getInstance().currentHardwareDevices) {
+	stopWorker();
+	delete buffers[0];
+	delete buffers[1];
+	foreach (hardwareDevice *dev, getInstrument().currentHardwareDevices) {
 		foreach (hardwareDevice::devicePin *pin, dev->devicePins.values()) {
 			foreach (hardwareDevice::pin_data data, pin->data.values()) {
 				if(data.dataArray)
@@ -57,46 +74,53 @@ interface::~interface()
 		}
 		qDeleteAll(dev->devicePins);
 	}
-	qDeleteAll(msa::getInstance().currentHardwareDevices);
-	msa::getInstance().currentHardwareDevices.clear();
+	qDeleteAll(getInstrument().currentHardwareDevices);
+	getInstrument().currentHardwareDevices.clear();
 }
 
 void interface::commandNextStep()
 {
 	if(currentStatus != status_paused)
 		return;
-	on_commandNextStep();
+	postCommand(command_next_step, true);
 }
 
 void interface::commandPreviousStep()
 {
 	if(currentStatus != status_paused)
 		return;
-	on_commandPreviousStep();
+	postCommand(command_previous_step, true);
 }
 
 void interface::pauseScan()
 {
 	currentStatus = status_paused;
+	postCommand(command_pause, true);
 	on_pausescan();
+	// the last samples of the interrupted sweep may not have reached a wakeup
+	wakeConsumer();
 }
 
 void interface::resumeScan()
 {
 	currentStatus = status_scanning;
 	on_resumescan();
+	postCommand(command_run, false);
 }
 
 void interface::autoScan()
 {
 	currentStatus = status_scanning;
 	on_autoscan();
+	postCommand(command_run, false);
 }
 
 void interface::cancelScan()
 {
 	currentStatus = status_halted;
+	postCommand(command_pause, true);
 	on_cancelscan();
+	wakeConsumer();
 }
 
 void interface::setStatus(interface::status stat)
@@ -121,20 +145,340 @@ void interface::setWriteReadDelay_us(unsigned long value)
 	on_setWriteReadDelay_us(value);
 }
 
+unsigned long interface::settleTime_us(quint32 step) const
+{
+	const sweepBuffer *sweep = activeSweep();
+	if(!sweep || (step >= sweep->steps))
+		return readDelay_us;
+	return qMin(readDelay_us, static_cast<unsigned long>(sweep->settle_us.at(int(step))));
+}
+
+bool interface::calibrateSettling(quint32 tolerance)
+{
+	if(isAcquiring())
+		return false;
+	{
+		QMutexLocker locker(&workerLock);
+		calibrationTolerance = tolerance;
+	}
+	return postCommand(command_calibrate_settling, false);
+}
+
+calParser::settlingCalData interface::getSettlingCalibration()
+{
+	QMutexLocker locker(&workerLock);
+	return calibrationResult;
+}
+
+bool interface::on_calibrateSettling(quint32 tolerance, calParser::settlingCalData &result)
+{
+	Q_UNUSED(tolerance)
+	Q_UNUSED(result)
+	return false;
+}
+
+bool interface::resumeAfterReconnect()
+{
+	return false;
+}
+
+void interface::setTransferTimeouts(unsigned int write_ms, unsigned int read_ms, unsigned int stall_ms)
+{
+	Q_UNUSED(write_ms)
+	Q_UNUSED(read_ms)
+	Q_UNUSED(stall_ms)
+}
+
+void interface::abortStep()
+{
+}
+
+bool interface::replan()
+{
+	postCommand(command_replan, true);
+	QMutexLocker locker(&workerLock);
+	return replanResult;
+}
+
+bool interface::isAcquiring()
+{
+	QMutexLocker locker(&workerLock);
+	return acquiring;
+}
+
+bool interface::postCommand(workerCommand command, bool waitDone)
+{
+	QMutexLocker locker(&workerLock);
+	if(!isRunning()) {
+		if(command == command_stop)
+			return true;
+		start();
+	}
+	commands.enqueue(command);
+	quint64 ticket = ++commandsPosted;
+	commandWake.wakeOne();
+	if(!waitDone)
+		return true;
+	// compiling a scan takes as long as it takes, the others only wait for the step in progress
+	unsigned long timeout = (command == command_replan) ? ULONG_MAX : WORKER_COMMAND_TIMEOUT_MS;
+	bool aborted = false;
+	while(commandsDone < ticket) {
+		if(commandDone.wait(&workerLock, timeout))
+			continue;
+		if(aborted)
+			return false;
+		// the step can be waiting on a transfer up to its deadline
+		aborted = true;
+		locker.unlock();
+		abortStep();
+		locker.relock();
+	}
+	return true;
+}
+
+void interface::stopWorker()
+{
+	if(!isRunning())
+		return;
+	postCommand(command_stop, true);
+	wait();
+}
+
+void interface::run()
+{
+	QMutexLocker locker(&workerLock);
+	forever {
+		if(!commands.isEmpty()) {
+			workerCommand command = commands.dequeue();
+			switch (command) {
+			case command_run:
+				stopRequested.storeRelease(0);
+				acquiring = true;
+				break;
+			case command_pause:
+			case command_stop:
+				acquiring = false;
+				locker.unlock();
+				on_acquisitionStopped();
+				locker.relock();
+				break;
+			default:
+				// the long commands run unlocked so the next ones can be queued meanwhile
+				locker.unlock();
+				if(command == command_replan)
+					replanResult = initScan();
+				else if(command == command_calibrate_settling) {
+					calParser::settlingCalData result;
+					locker.relock();
+					quint32 tolerance = calibrationTolerance;
+					locker.unlock();
+					bool ok = on_calibrateSettling(tolerance, result);
+					locker.relock();
+					calibrationResult = result;
+					locker.unlock();
+					emit settlingCalibrated(ok);
+				}
+				// there is nothing to step through before the first scan is compiled
+				else if(activeSweep() && (command == command_next_step))
+					on_commandNextStep();
+				else if(activeSweep())
+					on_commandPreviousStep();
+				locker.relock();
+				break;
+			}
+			++commandsDone;
+			commandDone.wakeAll();
+			if(command == command_stop)
+				return;
+			continue;
+		}
+		if(!acquiring) {
+			commandWake.wait(&workerLock);
+			continue;
+		}
+		locker.unlock();
+		// a scan compiled meanwhile replaces the current one between sweeps
+		if(isFirstOfSweep(currentStep))
+			adoptStagedScan();
+		bool stepped = activeSweep() && acquireStep();
+		locker.relock();
+		if(!stepped || stopRequested.fetchAndStoreOrdered(0))
+			acquiring = false;
+	}
+}
+
 bool interface::initScan()
 {
-	msa::scanStruct scan = msa::getInstance().currentScan;
-	numberOfSteps = scan.steps->keys().size();
-	if(msa::getInstance().getIsInverted())
-		currentStep = numberOfSteps;
-	else
-		currentStep = 0;
+	QMutexLocker locker(&sweepLock);
+	// a scan staged and not started yet is replaced too
+	staged.fetchAndStoreAcquire(nullptr);
+	sweepBuffer *sweep = spareSweep();
+	bool ok = compileScan(sweep, getInstrument().getSnapshot());
+	activateSweep(sweep);
+	return ok;
+}
+
+bool interface::canStageScan(quint32 steps)
+{
+	// streamed scans compile while acquired, from the device storage the next scan would be compiled into
+	const sweepBuffer *sweep = activeSweep();
+	return (currentStatus == status_scanning) && sweep && !sweep->streamed && !planStream::isStreamed(steps);
+}
+
+bool interface::stageScan(const msa::scanSnapshot &scan)
+{
+	// the acquisition doesn't adopt a scan while the next one is compiled, it is replaced anyway
+	QMutexLocker locker(&sweepLock);
+	// once taken back the acquisition can't swap, the buffer not acquired is free
+	staged.fetchAndStoreAcquire(nullptr);
+	sweepBuffer *sweep = spareSweep();
+	if(!compileScan(sweep, scan))
+		return false;
+	staged.storeRelease(sweep);
+	return true;
+}
+
+bool interface::compileScan(sweepBuffer *target, const msa::scanSnapshot &scan)
+{
+	target->snapshot = scan;
+	target->streamed = false;
+	target->frames.clear();
+	target->frameSize = 0;
+	// no scan was started yet, an empty sweep is compiled
+	if(!target->snapshot) {
+		target->steps = 0;
+		target->inverted = false;
+		target->sweepTime_us = 0;
+		target->settle_us.clear();
+		return false;
+	}
+	// the plan the snapshot was taken with, never changed once published
+	const scanPlan *plan = target->snapshot->steps.data();
+	target->steps = plan->size();
+	target->inverted = target->snapshot->inverted;
+	target->sweepTime_us = quint64(target->snapshot->configuration.sweepTime_ms * 1000);
+	target->settle_us = plan->settle_us;
 	return true;
 }
 
+int interface::resolutionFilterBank() const
+{
+	const sweepBuffer *sweep = activeSweep();
+	return (sweep && sweep->snapshot) ? sweep->snapshot->resolution_filter_bank : getInstrument().getResolution_filter_bank();
+}
+
+quint32 interface::firstStep(const sweepBuffer *sweep)
+{
+	return (sweep->inverted && sweep->steps) ? sweep->steps - 1 : 0;
+}
+
+interface::sweepBuffer *interface::spareSweep()
+{
+	for(int x = 0; x < 2; ++x) {
+		if(!buffers[x])
+			buffers[x] = createSweepBuffer();
+	}
+	return (active.loadAcquire() == buffers[0]) ? buffers[1] : buffers[0];
+}
+
+void interface::activateSweep(sweepBuffer *sweep)
+{
+	active.storeRelease(sweep);
+	numberOfSteps = sweep->steps;
+	sweepInverted = sweep->inverted;
+	currentStep = firstStep(sweep);
+	pacer.setSweepTime(sweep->sweepTime_us, numberOfSteps);
+	quint32 number = sweepNumber.load() + 1;
+	{
+		QMutexLocker locker(&snapshotsLock);
+		snapshotSweeps[number % SWEEP_SNAPSHOTS] = number;
+		sweepSnapshots[number % SWEEP_SNAPSHOTS] = sweep->snapshot;
+	}
+	sweepNumber = number;
+	on_sweepActivated();
+}
+
+void interface::adoptStagedScan()
+{
+	// a scan being staged keeps the current one for another sweep instead of stalling the acquisition
+	if(!staged.loadAcquire() || !sweepLock.tryLock())
+		return;
+	sweepBuffer *sweep = staged.fetchAndStoreAcquire(nullptr);
+	if(sweep)
+		activateSweep(sweep);
+	sweepLock.unlock();
+}
+
+bool interface::isFirstOfSweep(quint32 step) const
+{
+	if(sweepInverted)
+		return step == numberOfSteps - 1;
+	return step == 0;
+}
+
+bool interface::isLastOfSweep(quint32 step) const
+{
+	if(sweepInverted)
+		return step == 0;
+	return step + 1 == numberOfSteps;
+}
+
+void interface::publish(quint32 sweep, quint32 step, quint32 magnitude, quint32 phase)
+{
+	sampleRing::sample s;
+	s.step = step;
+	s.sweep = sweep;
+	s.magnitude = magnitude;
+	s.phase = phase;
+	s.timestamp_ns = sampleClock.nsecsElapsed();
+	samples.push(s);
+	if(isSignalConnected(QMetaMethod::fromSignal(&interface::dataReady)))
+		emit dataReady(step, magnitude, phase);
+	++sinceWakeup;
+	// single steps are shown right away, scans at the chunk and sweep boundaries
+	bool wake = (currentStatus != status_scanning) || isLastOfSweep(step);
+	if(wakeupChunk)
+		wake |= (sinceWakeup >= wakeupChunk) || (s.timestamp_ns - lastWakeup_ns >= SAMPLE_WAKEUP_NS);
+	if(!wake)
+		return;
+	sinceWakeup = 0;
+	lastWakeup_ns = s.timestamp_ns;
+	wakeConsumer();
+}
+
+quint32 interface::takeSamples(sampleRing::sample *dest, quint32 max)
+{
+	// rearmed before draining, a sample pushed meanwhile wakes the consumer again
+	wakeupPending.storeRelease(0);
+	return samples.drain(dest, max);
+}
+
+msa::scanSnapshot interface::sweepSnapshot(quint32 sweep) const
+{
+	QMutexLocker locker(&snapshotsLock);
+	if(!sweep || (snapshotSweeps[sweep % SWEEP_SNAPSHOTS] != sweep))
+		return msa::scanSnapshot();
+	return sweepSnapshots[sweep % SWEEP_SNAPSHOTS];
+}
+
+void interface::wakeConsumer()
+{
+	if(wakeupPending.testAndSetOrdered(0, 1))
+		emit samplesReady();
+}
+
+quint32 interface::nextStep(quint32 step) const
+{
+	if(numberOfSteps == 0)
+		return 0;
+	if(sweepInverted)
+		return (step == 0) ? numberOfSteps - 1 : step - 1;
+	return (step + 1 >= numberOfSteps) ? 0 : step + 1;
+}
+
 void interface::hardwareInit()
 {
-	foreach (hardwareDevice *dev, msa::getInstance().currentHardwareDevices.values()) {
+	foreach (hardwareDevice *dev, getInstrument().currentHardwareDevices.values()) {
 		dev->init();
 	}
 }
@@ -27,15 +27,35 @@
 #define INTERFACE_H
 
 #include <QThread>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QQueue>
+#include <QVector>
+#include <atomic>
 #include "../hardwaredevice.h"
 #include "../msa.h"
+#include "steppacer.h"
+#include "../samplering.h"
+
+// ADC counts within which a settling reading is considered converged
+#define SETTLE_CAL_TOLERANCE 32
+// samples after which the consumer is woken up during a scan
+#define SAMPLE_WAKEUP_CHUNK 64
+// longest a sample waits in the ring before the consumer is woken up
+#define SAMPLE_WAKEUP_NS 20000000
+// time a command waits for the step in progress before the step is aborted
+#define WORKER_COMMAND_TIMEOUT_MS 1000
+// snapshots of the last sweeps kept for the samples still waiting to be converted
+#define SWEEP_SNAPSHOTS 8
 
 class interface: public QThread
 {
 	Q_OBJECT
 public:
-	enum interface_types {USB, SIMULATOR};
-	interface(QObject *parent);
+	enum interface_types {USB, SIMULATOR, EMULATOR};
+	// instrument: the msa this interface drives, the default instrument if null
+	interface(QObject *parent, msa *instrument = nullptr);
 	~interface();
 	typedef enum {status_halted, status_paused, status_scanning} status;
 public slots:
@@ -53,31 +73,173 @@ public:
 	virtual bool init(int debugLevel) = 0;
 	void setWriteReadDelay_us(unsigned long value);
 	unsigned long getWriteReadDelay_us() {return readDelay_us;}
+	// wait before the ADC read of a scan step, never longer than the write/read delay
+	unsigned long settleTime_us(quint32 step) const;
+	// compiles the current scan of the instrument and acquires it from its first step
 	virtual bool initScan();
+	// compiles the current scan (initScan) on the acquisition thread and waits for it,
+	// the acquisition must be paused or halted
+	bool replan();
+	// true if a scan of steps can be compiled while the current one is acquired (stageScan)
+	bool canStageScan(quint32 steps);
+	// compiles scan while the current one is still acquired, it replaces it at the next
+	// sweep boundary. The current one keeps going on errors
+	bool stageScan(const msa::scanSnapshot &scan);
+	// the acquisition thread is stepping through the scan
+	bool isAcquiring();
 	void setScanConfiguration(msa::scanConfig configuration);
 	virtual void hardwareInit();
 	void errorOcurred(msa::MSAdevice dev, QString text, bool critical, bool sendToGUI);
 	int getDebugLevel() const;
 	void setDebugLevel(int value);
 	virtual interface_types type() = 0;
+	msa &getInstrument() const {return *instrument;}
+	void setInstrument(msa *value) {instrument = value;}
+	// measures, on the acquisition thread, how long the hardware takes to settle after LO jumps
+	// of the current scan and fits the settling model to it. The acquisition must be paused or
+	// halted, settlingCalibrated is emitted once done. False if it couldn't be started
+	bool calibrateSettling(quint32 tolerance);
+	// result of the last settling calibration
+	calParser::settlingCalData getSettlingCalibration();
+	// called when the connection comes back, reprograms the devices and continues the scan
+	// from where it was lost, false if a full hardwareInit and initScan are needed instead
+	virtual bool resumeAfterReconnect();
+	// deadlines of the hardware transfers and time without data after which the acquisition
+	// is considered stalled and restarted, in ms, 0 disables them
+	virtual void setTransferTimeouts(unsigned int write_ms, unsigned int read_ms, unsigned int stall_ms);
+	// consumer side of the acquired samples, only one thread may take them.
+	// Takes up to max samples and rearms samplesReady
+	quint32 takeSamples(sampleRing::sample *dest, quint32 max);
+	// samples between samplesReady signals during a scan, 0 wakes the consumer at the end of the sweeps only
+	void setWakeupChunk(quint32 samples) {wakeupChunk = samples;}
+	quint32 getDroppedSamples() const {return samples.getDropped();}
+	// configuration the samples of sweep were acquired with, null once SWEEP_SNAPSHOTS newer sweeps started
+	msa::scanSnapshot sweepSnapshot(quint32 sweep) const;
 signals:
+	// there are samples to take, not emitted again until takeSamples() is called
+	void samplesReady();
+	// the settling calibration finished, ok is false on errors and when the readings didn't settle
+	void settlingCalibrated(bool ok);
+	// per sample signal, only emitted when something is connected to it
 	void dataReady(quint32 step, quint32 magnitude, quint32 phase);
 	void connected();
 	void disconnected();
 	void errorTriggered(QString, bool, bool);
 protected:
-	virtual void on_autoscan() = 0;
-	virtual void on_cancelscan() = 0;
-	virtual void on_pausescan() = 0;
-	virtual void on_resumescan() = 0;
+	// what the acquisition needs of a compiled scan, the instrument scan and configuration
+	// are not read while acquiring. Two are kept, the one acquired and the one compiled next
+	class sweepBuffer
+	{
+	public:
+		virtual ~sweepBuffer() {}
+		// the configuration the sweep was compiled with, read instead of the instrument one
+		msa::scanSnapshot snapshot;
+		quint32 steps;
+		bool inverted;
+		quint64 sweepTime_us;
+		// wait before the ADC read of each step, capped by the write/read delay when used
+		QVector<quint32> settle_us;
+		// the device plans are streamed through the ring of a planStream while acquired
+		bool streamed;
+		// hardware frames of the step slots, frameSize bytes each
+		QByteArray frames;
+		int frameSize;
+	};
+	// the interfaces with more per scan settings return their own sweepBuffer
+	virtual sweepBuffer *createSweepBuffer() {return new sweepBuffer;}
+	// fills target with scan, the derived classes compile their frames into it,
+	// false on errors. Doesn't touch the scan being acquired
+	virtual bool compileScan(sweepBuffer *target, const msa::scanSnapshot &scan);
+	// called when a compiled scan starts being acquired, from the acquisition thread
+	// unless it is halted
+	virtual void on_sweepActivated() {}
+	const sweepBuffer *activeSweep() const {return active.loadAcquire();}
+	// resolution filter of the sweep being acquired, the instrument one before the first scan
+	int resolutionFilterBank() const;
+	// first step of a sweep of sweep in its direction
+	static quint32 firstStep(const sweepBuffer *sweep);
+	// commands of the acquisition thread, carried out between steps in the order they are queued
+	typedef enum {command_run, command_pause, command_next_step, command_previous_step, command_replan, command_calibrate_settling, command_stop} workerCommand;
+	// queues a command to the acquisition thread, which is started if needed. With waitDone it
+	// returns once the command was carried out, false if the step in progress didn't finish in time
+	bool postCommand(workerCommand command, bool waitDone);
+	// one step of the scan, called from the acquisition thread, false stops the acquisition
+	virtual bool acquireStep() = 0;
+	// makes the step in progress return, called when it holds a command for too long
+	virtual void abortStep();
+	// stops the acquisition after the step in progress, can be called from inside a step
+	void stopAcquisition() {stopRequested.storeRelease(1);}
+	// ends the acquisition thread, the derived classes call it before their members go away
+	void stopWorker();
+	// the settling calibration itself, called from the acquisition thread
+	virtual bool on_calibrateSettling(quint32 tolerance, calParser::settlingCalData &result);
+	// called before the acquisition thread starts stepping
+	virtual void on_autoscan() {}
+	virtual void on_resumescan() {}
+	// called from the acquisition thread when it stops stepping, before a pause or halt returns,
+	// the background work of the scan ends here so the next one can be built
+	virtual void on_acquisitionStopped() {}
+	// called once the acquisition thread stopped stepping
+	virtual void on_cancelscan() {}
+	virtual void on_pausescan() {}
 	virtual void on_setWriteReadDelay_us(unsigned long value) = 0;
-	quint32 currentStep;
+	// set by the acquisition thread when a sweep is activated, also read by the transfer and GUI threads
+	std::atomic<quint32> currentStep;
 	quint32 lastCommandedStep;
-	quint32 numberOfSteps;
+	std::atomic<quint32> numberOfSteps;
 	int debugLevel;
 	status currentStatus;
 	unsigned long readDelay_us;
+	stepPacer pacer;
+	msa *instrument;
+	// direction of the scan being acquired
+	std::atomic<bool> sweepInverted;
+	bool isFirstOfSweep(quint32 step) const;
+	bool isLastOfSweep(quint32 step) const;
+	// sweep being acquired, counts the activated sweeps from 1
+	quint32 currentSweep() const {return sweepNumber.load();}
+	// stores a sample acquired in sweep, must always be called from the same thread while scanning
+	void publish(quint32 sweep, quint32 step, quint32 magnitude, quint32 phase);
+	// step acquired after step, in the scan direction
+	quint32 nextStep(quint32 step) const;
 private:
+	void run();
+	void wakeConsumer();
+	// the buffer that is neither acquired nor waiting, the caller must have taken back the waiting one
+	sweepBuffer *spareSweep();
+	void activateSweep(sweepBuffer *sweep);
+	// swaps in the scan compiled by stageScan, from the acquisition thread at a sweep boundary
+	void adoptStagedScan();
+	sweepBuffer *buffers[2];
+	// held while the buffers change hands: activating a sweep, and compiling and staging the next one,
+	// so the spare buffer is never the one being activated
+	QMutex sweepLock;
+	QAtomicPointer<sweepBuffer> active;
+	QAtomicPointer<sweepBuffer> staged;
+	std::atomic<quint32> sweepNumber;
+	// snapshots of the recent sweeps, by sweep number modulo SWEEP_SNAPSHOTS
+	mutable QMutex snapshotsLock;
+	quint32 snapshotSweeps[SWEEP_SNAPSHOTS];
+	msa::scanSnapshot sweepSnapshots[SWEEP_SNAPSHOTS];
+	sampleRing samples;
+	QElapsedTimer sampleClock;
+	QAtomicInt wakeupPending;
+	quint32 wakeupChunk;
+	// producer side only
+	quint32 sinceWakeup;
+	qint64 lastWakeup_ns;
+	// acquisition thread state
+	QMutex workerLock;
+	QWaitCondition commandWake;
+	QWaitCondition commandDone;
+	QQueue<workerCommand> commands;
+	quint64 commandsPosted;
+	quint64 commandsDone;
+	bool acquiring;
+	bool replanResult;
+	quint32 calibrationTolerance;
+	calParser::settlingCalData calibrationResult;
+	QAtomicInt stopRequested;
 };
 
 #endif // INTERFACE_H
@@ -29,10 +29,12 @@
 #include "../lmx2326.h"
 #include "../ad9850.h"
 #include "../msa.h"
+#include "../scanplan.h"
+#include "../plancompiler.h"
 #include <QTimer>
 #include <QRandomGenerator>
 
-simulator::simulator(QObject *parent): interface(parent), autoConnect(true), singleStep(false),
+simulator::simulator(QObject *parent, msa *instrument): interface(parent, instrument), stepPlan(this), autoConnect(true), singleStep(false),
 	pll1data(nullptr),pll1le(nullptr),dds1data(nullptr),dds1fqu(nullptr),pll2data(nullptr),pll2le(nullptr),dds3data(nullptr),dds3fqu(nullptr)
 	,pll3data(nullptr),pll3le(nullptr),pll1(nullptr),pll2(nullptr),pll3(nullptr),dds1(nullptr),dds3(nullptr),adcmag(nullptr),adcph(nullptr)
 {
@@ -63,16 +65,17 @@ bool simulator::init(int debugLevel)
 
 simulator::~simulator()
 {
-	this->requestInterruption();
-	QThread::usleep(500);
+	stopWorker();
 }
 
 void simulator::commandStep(quint32 step)
 {
-	quint32 totalSteps = msa::getInstance().getScanConfiguration().gui.steps_number;
-	double currentStepPart = double(step) / totalSteps;
-	QThread::usleep(readDelay_us);
-	emit dataReady(step, quint32(5000 * (QRandomGenerator::global()->generateDouble() + sin(currentStepPart * 2 * M_PI)) + 20000), quint32(5000 * ( QRandomGenerator::global()->generateDouble()+cos(currentStepPart * 2 * M_PI)) + 20000));
+	double currentStepPart = double(step) / numberOfSteps;
+	// keeps the streamed plan going like the hardware would
+	if(activeSweep()->streamed)
+		stepPlan.slotOf(step, sweepInverted);
+	stepPacer::wait(settleTime_us(step));
+	publish(currentSweep(), step, quint32(5000 * (QRandomGenerator::global()->generateDouble() + sin(currentStepPart * 2 * M_PI)) + 20000), quint32(5000 * ( QRandomGenerator::global()->generateDouble()+cos(currentStepPart * 2 * M_PI)) + 20000));
 	//emit dataReady(step, quint32(5000 + 10000), 0);
 }
 
@@ -84,11 +87,11 @@ bool simulator::getIsConnected() const
 void simulator::on_commandNextStep()
 {
 	commandStep(currentStep);
-	if(!msa::getInstance().getIsInverted())
+	if(!sweepInverted)
 		++currentStep;
 	if(currentStep > (numberOfSteps - 1))
 		currentStep = 0;
-	if(msa::getInstance().getIsInverted()) {
+	if(sweepInverted) {
 		if(currentStep == 0)
 			currentStep = numberOfSteps -1;
 		else {
@@ -99,68 +102,53 @@ void simulator::on_commandNextStep()
 
 void simulator::on_commandPreviousStep()
 {
-	if(!msa::getInstance().getIsInverted()) {
+	if(!sweepInverted) {
 		if(currentStep == 0)
 			currentStep = numberOfSteps - 1;
 		else
 			--currentStep;
 	}
-	if(msa::getInstance().getIsInverted())
+	if(sweepInverted)
 		++currentStep;
 	if(currentStep > (numberOfSteps - 1))
 		currentStep = 0;
 	commandStep(currentStep);
 }
 
-bool simulator::initScan()
+void simulator::on_acquisitionStopped()
 {
-	QList<hardwareDevice::devicePin*> dataPins;
-	int maxSize = 0;
+	// no chunk is compiled in the background while halted, the instrument may rebuild the plans
+	stepPlan.stop();
+}
+
+bool simulator::compileScan(sweepBuffer *target, const msa::scanSnapshot &scan)
+{
+	if(!interface::compileScan(target, scan))
+		return false;
 	bool error = false;
-	interface::initScan();
-	if(pll1)
-		error |= pll1->processNewScan();
-	if(dds1)
-		error |= dds1->processNewScan();
-	if(pll3)
-		error |= pll3->processNewScan();
-	if(dds3)
-		error |= dds3->processNewScan();
-	if(error)
-		msa::getInstance().currentInterface->errorOcurred(msa::MSA, "Error ocurred processing new scan", true, true);
-	qDeleteAll(usbData.values());
-	usbData.clear();
-	foreach (hardwareDevice *dev, msa::getInstance().currentHardwareDevices.values()) {
+	const msa::scanConfig &config = target->snapshot->configuration;
+	QList<planCompiler::deviceChain> chains;
+	// DDS1 depends on PLL1's PFD table and DDS3 on PLL3's, the two chains are independent
+	chains << (planCompiler::deviceChain() << pll1 << dds1);
+	chains << (planCompiler::deviceChain() << pll3 << dds3);
+	quint32 slots = stepPlan.prepare(chains, target->snapshot, [this, target](quint32 slot, quint32 count) {buildStepFrames(target, slot, count);});
+	target->streamed = stepPlan.isStreaming();
+	serializer.clear();
+	foreach (hardwareDevice *dev, getInstrument().currentHardwareDevices.values()) {
+		if(quint32(dev->getStepRegisters().size()) != slots)
+			continue;
 		foreach (hardwareDevice::devicePin *pin, dev->getDevicePins().values()) {
-			if(pin->IOtype == hardwareDevice::MAIN_DATA) {
-				dataPins.append(pin);
-				if(pin->data.contains(0) && pin->data.value(0).dataArray->size() > maxSize)
-					maxSize = pin->data.value(0).dataArray->size();
-			}
-		}
-	}
-	int delta;
-	for(quint32 step = 0; step < quint32(msa::getInstance().currentScan.steps->size()); ++step) {
-		QByteArray *arr = new QByteArray;
-		usbData.insert(step, arr);
-		for(int b = 0; b < maxSize; ++b) {
-			uint8_t byte = 0;
-			foreach (hardwareDevice::devicePin *pin, dataPins) {
-				if(!pin->hwconfig)
-					continue;
-				if(pin->data.contains(step)) {
-					delta = maxSize - pin->data.value(step).dataArray->size() + pin->data.value(step).dataMask->count(0);
-
-					if(b >= delta) {
-						byte = uint8_t((byte & (static_cast<parallelEqui*>(pin->hwconfig))->mask) | pin->data.value(step).dataArray->at(b - delta) << (static_cast<parallelEqui*>(pin->hwconfig))->pin);
-					}
-				}
-			}
-			arr->append(char(byte | msa::getInstance().getResolution_filter_bank()));
+			if((pin->IOtype == hardwareDevice::MAIN_DATA) && pin->hwconfig)
+				serializer.addLine(dev->getStepRegisters(), dev->getRegisterSize(), dev->getBitOrder(), (static_cast<parallelEqui*>(pin->hwconfig))->pin);
 		}
 	}
+	target->frameSize = serializer.frameSize();
+	target->frames.fill(0, int(slots) * target->frameSize);
+	error |= stepPlan.start(firstStep(target));
+	if(error)
+		errorOcurred(msa::MSA, "Error ocurred processing new scan", true, true);
 	adcSend.clear();
-	if((msa::getInstance().currentScan.configuration.scanType != ComProtocol::VNA_Rec) && (msa::getInstance().currentScan.configuration.scanType != ComProtocol::VNA_Trans)) {
+	if((config.scanType != ComProtocol::VNA_Rec) && (config.scanType != ComProtocol::VNA_Trans)) {
 		adcSend.append(char(0xB2));//TODO
 	}
 	else
@@ -173,7 +161,7 @@ bool simulator::initScan()
 	else {
 		adcSend.append(0x01);adcSend.append(0x03);adcSend.append(0x0C);
 	}
-	adcSend.append(char(msa::getInstance().currentScan.configuration.adcAveraging));
+	adcSend.append(char(config.adcAveraging));
 	return !error;
 }
 //first load the parallelEui struct with the configuration of each device (latch,pin, etc...)
@@ -181,7 +169,7 @@ bool simulator::initScan()
 void simulator::hardwareInit()
 {
 	interface::hardwareInit();
-	QHash<msa::MSAdevice, hardwareDevice *> loadedDevices = msa::getInstance().currentHardwareDevices;
+	QHash<msa::MSAdevice, hardwareDevice *> loadedDevices = getInstrument().currentHardwareDevices;
 	foreach(hardwareDevice* dev, loadedDevices.values()) {
 		if((loadedDevices.key(dev) == msa::PLL1) || (loadedDevices.key(dev) == msa::PLL2) || (loadedDevices.key(dev) == msa::PLL3)) {
 			genericPLL *pll = qobject_cast<genericPLL*>(dev);
@@ -394,25 +382,20 @@ QByteArray simulator::convertStringToByteArray(QString str) {
 	return ret;
 }
 
-void simulator::run()
+bool simulator::acquireStep()
 {
-	forever {
-		if ( QThread::currentThread()->isInterruptionRequested() ) {
-			return;
-		}
-		commandStep(currentStep);
-		if(!msa::getInstance().getIsInverted())
-			++currentStep;
-		if(currentStep > (numberOfSteps - 1))//TODO was >=
-			currentStep = 0;
-		if(msa::getInstance().getIsInverted()) {
-			if(currentStep == 0)
-				currentStep = numberOfSteps - 1;
-			else
-				--currentStep;
-		}
-	}
-	qDebug() << "EXIT RUN";
+	pacer.stepStarting(isFirstOfSweep(currentStep));
+	commandStep(currentStep);
+	pacer.stepDone();
+	currentStep = nextStep(currentStep);
+	return true;
+}
+
+void simulator::buildStepFrames(sweepBuffer *sweep, quint32 slot, quint32 count)
+{
+	uint8_t resolutionFilter = uint8_t(sweep->snapshot->resolution_filter_bank);
+	for(quint32 x = slot; x < slot + count; ++x)
+		serializer.serialize(x, sweep->frames.data() + int(x) * sweep->frameSize, resolutionFilter);
 }
 
 void simulator::commandInitStep(hardwareDevice *dev, quint32 step) {
@@ -430,28 +413,6 @@ QString simulator::byteToString(uint8_t byte) {
 	return str;
 }
 
-void simulator::on_autoscan()
-{
-	this->start();
-}
-
-void simulator::on_pausescan()
-{
-	this->requestInterruption();
-	this->wait(1000);
-}
-
-void simulator::on_resumescan()
-{
-	this->start();
-}
-
-void simulator::on_cancelscan()
-{
-	this->requestInterruption();
-	this->wait(1000);
-}
-
 bool simulator::getAutoConnect() const
 {
 	return autoConnect;
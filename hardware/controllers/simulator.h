@@ -35,13 +35,15 @@
 #include "../lmx2326.h"
 #include "../ad9850.h"
 #include "../genericadc.h"
+#include "../planstream.h"
+#include "../registerserializer.h"
 
 
 class simulator : public interface
 {
 	Q_OBJECT
 public:
-	simulator(QObject *parent);
+	simulator(QObject *parent, msa *instrument = nullptr);
 	bool init(int debugLevel);
 	~simulator();
 	bool openDevice(int deviceNumber);
@@ -49,17 +51,14 @@ public:
 	bool getAutoConnect() const;
 	void setAutoConnect(bool value);
 	bool getIsConnected() const;
-	bool initScan();
 	void hardwareInit();
 	QByteArray convertStringToByteArray(QString str);
 	bool sendArrayForDebug(QByteArray);
 	interface_types type() {return SIMULATOR;}
 protected:
-	void run();
-	void on_autoscan();
-	void on_pausescan();
-	void on_resumescan();
-	void on_cancelscan();
+	bool acquireStep();
+	bool compileScan(sweepBuffer *target, const msa::scanSnapshot &scan);
+	void on_acquisitionStopped();
 	void on_commandNextStep();
 	void on_commandPreviousStep();
 	void on_setWriteReadDelay_us(unsigned long value);
@@ -120,7 +119,11 @@ private:
 	QString byteToString(uint8_t byte);
 	QString constructString(uint8_t latch1, uint8_t latch2, uint8_t latch3, uint8_t latch4, QString clock);
 	void usbToString(QByteArray array, bool print, int temp);
-	QHash<quint32, QByteArray *> usbData;
+	// compiles the device plans, streamed ahead of the acquisition for large scans
+	planStream stepPlan;
+	registerSerializer serializer;
+	// fills the latch data of count slots of sweep, called by stepPlan once their registers are compiled
+	void buildStepFrames(sweepBuffer *sweep, quint32 slot, quint32 count);
 	void printUSBData(quint32 step);
 	QByteArray adcSend;
 	int expectedAdcSize;
@@ -0,0 +1,294 @@
+/**
+ ******************************************************************************
+ *
+ * @file       main.cpp
+ * @author     Jose Barros (AKA PT_Dreamer) josemanuelbarros@gmail.com 2019
+ * @brief      slimemulator.cpp file
+ * @see        The GNU Public License (GPL) Version 3
+ * @defgroup   slimEmulator
+ * @{
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+#include "slimemulator.h"
+#include "../registerfield.h"
+#include <QRandomGenerator>
+#include <QDebug>
+#include <cmath>
+#include <cstring>
+
+// usb latch numbers, see slimusb::latchToUSBNumber
+#define USB_LATCH_DATA 1
+#define USB_LATCH_STROBE 3
+#define USB_LATCH_STEP 7
+// latch 1, clock of the PLLs and DDSs
+#define PIN_CLK 0
+// latch 2, PLL load enable and DDS frequency update
+#define PIN_PLL1_LE 0
+#define PIN_DDS1_FQUD 1
+#define PIN_PLL3_LE 2
+#define PIN_DDS3_FQUD 3
+#define PIN_PLL2_LE 4
+#define LMX2326_BITS 21
+#define AD9850_BITS 40
+// PLL prescaler, N = B * 32 + A
+#define PRESCALER 32
+#define DDS_ACCUMULATOR 4294967296.0
+// modeled ADC counts
+#define ADC_FLOOR 3000
+#define ADC_SPAN 40000
+#define ADC_NOISE 16
+#define ADC_PHASE_CENTER 32768
+#define ADC_MAX 65535
+
+// LMX2326 fields, bit numbering as in lmx2326.h
+typedef registerField<0, 2> LMX_CONTROL;
+typedef registerField<2, 14> LMX_R_DIVIDER;
+typedef registerField<2, 5> LMX_A_COUNTER;
+typedef registerField<7, 13> LMX_B_COUNTER;
+typedef registerField<0, 32> DDS_FREQUENCY;
+
+// data pin of each line on latch 1
+static const int linePin[] = {1, 2, 3, 4, 4};
+
+slimEmulator::slimEmulator():LO1from(0), LO1to(0), oscillator(64), LO2(1024), IFcenter(10.7), bandwidth(0.015), baseFrequency(0), scanType(ComProtocol::SA)
+{
+	memset(latches, 0, sizeof(latches));
+	memset(shiftRegisters, 0, sizeof(shiftRegisters));
+	memset(plls, 0, sizeof(plls));
+	memset(ddsTuning, 0, sizeof(ddsTuning));
+	LO1change.start();
+}
+
+void slimEmulator::setConfiguration(const msa::scanConfig &configuration)
+{
+	QMutexLocker locker(&mutex);
+	oscillator = configuration.masterOscilatorFrequency;
+	LO2 = configuration.LO2;
+	IFcenter = configuration.pathCalibration.centerFreq_MHZ;
+	bandwidth = configuration.pathCalibration.bandwidth_MHZ;
+	baseFrequency = configuration.baseFrequency;
+	scanType = configuration.scanType;
+}
+
+void slimEmulator::write(const unsigned char *data, int size)
+{
+	QMutexLocker locker(&mutex);
+	int position = 0;
+	while(position < size) {
+		int used = command(data + position, size - position);
+		if(used == 0) {
+			qDebug() << "emulator: unknown command" << data[position] << "dropping" << size - position << "bytes";
+			return;
+		}
+		position += used;
+	}
+}
+
+int slimEmulator::read(unsigned char *data, int size)
+{
+	QMutexLocker locker(&mutex);
+	if(replies.isEmpty())
+		return 0;
+	QByteArray reply = replies.dequeue();
+	int copied = qMin(size, reply.size());
+	memcpy(data, reply.constData(), size_t(copied));
+	return copied;
+}
+
+bool slimEmulator::hasReply()
+{
+	QMutexLocker locker(&mutex);
+	return !replies.isEmpty();
+}
+
+double slimEmulator::frequency(msa::MSAdevice device)
+{
+	QMutexLocker locker(&mutex);
+	return deviceFrequency(device);
+}
+
+int slimEmulator::command(const unsigned char *data, int size)
+{
+	if(data[0] == 0xB2) {
+		// 0xB2, ADC type (3 bytes), averaging
+		if(size < 5)
+			return 0;
+		queueReply();
+		return 5;
+	}
+	if(((data[0] & 0xF0) != 0xA0) || (size < 3) || (size < 3 + data[1]))
+		return 0;
+	int usbLatch = data[0] & 0x0F;
+	int length = data[1];
+	bool autoClock = data[2];
+	const unsigned char *bytes = data + 3;
+	if(usbLatch == USB_LATCH_STEP) {
+		// step frame, one byte per clock, the registers are loaded at the end of the frame
+		for(int x = 0; x < length; ++x)
+			setLatch(USB_LATCH_DATA, bytes[x], true);
+		latchPLL(0, LINE_PLL1);
+		latchPLL(2, LINE_PLL3);
+		latchDDS(0, LINE_DDS1);
+		latchDDS(1, LINE_DDS3);
+		retune();
+	}
+	else if(usbLatch < 4) {
+		for(int x = 0; x < length; ++x)
+			setLatch(usbLatch, bytes[x], autoClock);
+	}
+	else
+		return 0;
+	return 3 + length;
+}
+
+void slimEmulator::setLatch(int usbLatch, uint8_t value, bool autoClock)
+{
+	uint8_t rising = value & ~latches[usbLatch];
+	latches[usbLatch] = value;
+	if(usbLatch == USB_LATCH_DATA) {
+		// the firmware pulses the clock after each byte, otherwise the clock pin is driven by the data
+		if(autoClock || (rising & (1 << PIN_CLK)))
+			clockIn();
+	}
+	else if(usbLatch == USB_LATCH_STROBE) {
+		if(rising & (1 << PIN_PLL1_LE))
+			latchPLL(0, LINE_PLL1);
+		if(rising & (1 << PIN_PLL2_LE))
+			latchPLL(1, LINE_PLL2);
+		if(rising & (1 << PIN_PLL3_LE))
+			latchPLL(2, LINE_PLL3);
+		if(rising & (1 << PIN_DDS1_FQUD))
+			latchDDS(0, LINE_DDS1);
+		if(rising & (1 << PIN_DDS3_FQUD))
+			latchDDS(1, LINE_DDS3);
+		if(rising)
+			retune();
+	}
+}
+
+void slimEmulator::clockIn()
+{
+	for(int line = 0; line < LINES_NUMBER; ++line)
+		shiftRegisters[line] = (shiftRegisters[line] << 1) | ((latches[USB_LATCH_DATA] >> linePin[line]) & 1);
+}
+
+void slimEmulator::latchPLL(int pll, dataLine line)
+{
+	// MSB first, the register is made of the last bits clocked in
+	quint64 reg = shiftRegisters[line] & ((quint64(1) << LMX2326_BITS) - 1);
+	// lines not driven by the frame shift in zeros, a zero divider is never a valid load
+	switch (LMX_CONTROL::get(reg)) {
+	case 0:
+		if(LMX_R_DIVIDER::get(reg))
+			plls[pll].R = LMX_R_DIVIDER::get(reg);
+		break;
+	case 1:
+		if(LMX_B_COUNTER::get(reg))
+			plls[pll].N = LMX_B_COUNTER::get(reg) * PRESCALER + LMX_A_COUNTER::get(reg);
+		break;
+	default:
+		// function and initialization latches don't change the frequency
+		break;
+	}
+}
+
+void slimEmulator::latchDDS(int dds, dataLine line)
+{
+	// LSB first, the first bit clocked in is now the highest of the last 40
+	quint64 shifted = shiftRegisters[line];
+	quint64 reg = 0;
+	for(int bit = 0; bit < AD9850_BITS; ++bit)
+		reg |= ((shifted >> (AD9850_BITS - 1 - bit)) & 1) << bit;
+	ddsTuning[dds] = DDS_FREQUENCY::get(reg);
+}
+
+double slimEmulator::pllFrequency(int pll, double reference) const
+{
+	if(plls[pll].R == 0)
+		return 0;
+	return plls[pll].N * reference / plls[pll].R;
+}
+
+double slimEmulator::ddsFrequency(int dds) const
+{
+	return ddsTuning[dds] * oscillator / DDS_ACCUMULATOR;
+}
+
+double slimEmulator::deviceFrequency(msa::MSAdevice device) const
+{
+	switch (device) {
+	case msa::PLL1:
+		return pllFrequency(0, ddsFrequency(0));
+	case msa::PLL2:
+		return pllFrequency(1, oscillator);
+	case msa::PLL3:
+		return pllFrequency(2, ddsFrequency(1));
+	case msa::DDS1:
+		return ddsFrequency(0);
+	case msa::DDS3:
+		return ddsFrequency(1);
+	default:
+		return 0;
+	}
+}
+
+void slimEmulator::retune()
+{
+	double target = deviceFrequency(msa::PLL1);
+	if(target == LO1to)
+		return;
+	// the first lock after power up is not modeled
+	LO1from = (LO1to == 0) ? target : currentLO1();
+	LO1to = target;
+	LO1change.restart();
+}
+
+double slimEmulator::currentLO1() const
+{
+	double elapsed_us = LO1change.nsecsElapsed() / 1000.0;
+	return LO1to + (LO1from - LO1to) * std::exp(-elapsed_us / EMULATOR_PLL_TAU_US);
+}
+
+void slimEmulator::queueReply()
+{
+	double LO1 = currentLO1();
+	// frequency the final filter is centered on, as frequencyKernel::LO1 computes it backwards
+	double input = LO1 - LO2 + IFcenter - baseFrequency;
+	double deviation = 0;
+	double level = 1;
+	// with the tracking generator or the VNA the input follows the LO, a through connection
+	if((scanType == ComProtocol::SA) || (scanType == ComProtocol::SA_SG)) {
+		double sigma = qMax(bandwidth / 2, 1e-6);
+		deviation = (input - EMULATOR_SIGNAL_MHZ) / sigma;
+		level = std::exp(-0.5 * deviation * deviation);
+	}
+	quint32 mag = quint32(ADC_FLOOR + ADC_SPAN * level) + QRandomGenerator::global()->bounded(ADC_NOISE);
+	quint32 phase = quint32(qBound(0.0, ADC_PHASE_CENTER + deviation * 4096, double(ADC_MAX)));
+	bool locked = qAbs(LO1 - LO1to) < EMULATOR_LOCK_MHZ;
+	QByteArray reply(EMULATOR_REPLY_SIZE, 0);
+	unsigned char *r = reinterpret_cast<unsigned char *>(reply.data());
+	r[0] = 0xB2;
+	// the lock detect can be wired to any of the ports
+	for(int port = 2; port < 7; ++port)
+		r[port] = locked ? 0xFF : 0x00;
+	r[7] = 1;
+	for(int x = 0; x < 4; ++x) {
+		r[8 + x] = uint8_t(mag >> (8 * x));
+		r[12 + x] = uint8_t(phase >> (8 * x));
+	}
+	replies.enqueue(reply);
+}
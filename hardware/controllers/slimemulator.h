@@ -0,0 +1,103 @@
+/**
+ ******************************************************************************
+ *
+ * @file       main.cpp
+ * @author     Jose Barros (AKA PT_Dreamer) josemanuelbarros@gmail.com 2019
+ * @brief      slimemulator.h file
+ * @see        The GNU Public License (GPL) Version 3
+ * @defgroup   slimEmulator
+ * @{
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef SLIMEMULATOR_H
+#define SLIMEMULATOR_H
+
+#include <QMutex>
+#include <QQueue>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include "../msa.h"
+
+// frequency in MHz of the tone seen by the emulated spectrum analyzer
+#define EMULATOR_SIGNAL_MHZ 100
+// time constant of the modeled PLL1 loop, in us
+#define EMULATOR_PLL_TAU_US 20
+// LO1 closer than this to its target in MHz reads as locked
+#define EMULATOR_LOCK_MHZ 0.001
+// size of the reply to the 0xB2 command
+#define EMULATOR_REPLY_SIZE 16
+
+// In-process emulation of the SLIM USB firmware and the MSA behind it.
+// Decodes the OUT transfers as the firmware would, drives the latch lines into
+// the LMX2326 and AD9850 shift registers, and answers the ADC requests from a
+// model of the signal at the synthesized LO1, which settles with the PLL time constant.
+// The latch and pin assignment is the one slimusb::hardwareInit uses.
+// Used by usbdevice in place of the real device, it is thread safe.
+class slimEmulator
+{
+public:
+	slimEmulator();
+	// oscillator, IF and filter the LOs and the signal are computed with
+	void setConfiguration(const msa::scanConfig &configuration);
+	// consumes one OUT transfer, which can hold several commands
+	void write(const unsigned char *data, int size);
+	// copies the oldest pending reply, returns the bytes copied or 0 if there is none
+	int read(unsigned char *data, int size);
+	bool hasReply();
+	// synthesized frequency in MHz of PLL1, PLL2, PLL3, DDS1 or DDS3, 0 while not programmed
+	double frequency(msa::MSAdevice device);
+private:
+	// serial data lines, PLL2 and DDS3 share the same pin
+	typedef enum {LINE_PLL1, LINE_DDS1, LINE_PLL3, LINE_PLL2, LINE_DDS3, LINES_NUMBER} dataLine;
+	typedef struct {
+		quint32 R;
+		quint32 N;
+	} pllState;
+	QMutex mutex;
+	// last value written to each usb latch
+	uint8_t latches[4];
+	quint64 shiftRegisters[LINES_NUMBER];
+	pllState plls[3];
+	quint32 ddsTuning[2];
+	// LO1 moves from LO1from to LO1to since LO1change
+	double LO1from;
+	double LO1to;
+	QElapsedTimer LO1change;
+	double oscillator;
+	double LO2;
+	double IFcenter;
+	double bandwidth;
+	double baseFrequency;
+	ComProtocol::scanType_t scanType;
+	QQueue<QByteArray> replies;
+	// the following must be called with mutex held
+	// returns the size of the command at data, 0 if it is unknown or incomplete
+	int command(const unsigned char *data, int size);
+	void setLatch(int usbLatch, uint8_t value, bool autoClock);
+	void clockIn();
+	void latchPLL(int pll, dataLine line);
+	void latchDDS(int dds, dataLine line);
+	double pllFrequency(int pll, double reference) const;
+	double ddsFrequency(int dds) const;
+	double deviceFrequency(msa::MSAdevice device) const;
+	// starts the settling of LO1 when its target changed
+	void retune();
+	double currentLO1() const;
+	void queueReply();
+};
+
+#endif // SLIMEMULATOR_H
@@ -29,14 +29,37 @@
 #include "../lmx2326.h"
 #include "../ad9850.h"
 #include "../msa.h"
-slimusb::slimusb(QObject *parent): interface(parent), usb(parent), autoConnect(true), singleStep(false),
+#include "../scanplan.h"
+#include "../plancompiler.h"
+#include <QVarLengthArray>
+#include <cstddef>
+#include <cstring>
+
+// measurements per LO jump, the slowest one is kept
+#define SETTLE_CAL_REPEATS 3
+// consecutive readings within tolerance that make a converged reading
+#define SETTLE_CAL_STABLE_READINGS 5
+// gives up waiting for the convergence after this
+#define SETTLE_CAL_TIMEOUT_US 100000
+// time without ADC replies after which the acquisition is restarted
+#define STALL_TIMEOUT_MS 2000
+#define STALL_CHECK_MS 500
+slimusb::slimusb(QObject *parent, bool emulated, msa *instrument): interface(parent, instrument), usb(parent), autoConnect(true), emulated(emulated), singleStep(false),
 	pll1data(nullptr),pll1le(nullptr),dds1data(nullptr),dds1fqu(nullptr),pll2data(nullptr),pll2le(nullptr),dds3data(nullptr),dds3fqu(nullptr)
-	,pll3data(nullptr),pll3le(nullptr),pll1(nullptr),pll2(nullptr),pll3(nullptr),dds1(nullptr),dds3(nullptr),adcmag(nullptr),adcph(nullptr)
+	,pll3data(nullptr),pll3le(nullptr),pll1(nullptr),pll2(nullptr),pll3(nullptr),dds1(nullptr),dds3(nullptr),adcmag(nullptr),adcph(nullptr),stepPlan(this)
 {
 	readDelay_us = 100;
+	framesSent = 0;
+	memset(debugLatches, 0, sizeof(debugLatches));
+	scanReady = false;
+	lastReceivedStep = -1;
+	stallTimeout_ms = STALL_TIMEOUT_MS;
+	stalls = 0;
+	statusReplies = 0;
+	memset(statusReply, 0, sizeof(statusReply));
+	progressClock.start();
+	lastProgress_ms = 0;
 	lastCommandedStep = 0;
-	usbB2union.command.adcMAG = 0;
-	usbB2union.command.adcPhase = 0;
 	latchToUSBNumber.insert(1,1);
 	latchToUSBNumber.insert(2,3);
 	latchToUSBNumber.insert(3,0);
@@ -47,11 +70,10 @@ slimusb::slimusb(QObject *parent): interface(parent), usb(parent), autoConnect(t
 	adcmag = adcph = nullptr;
 	connect(&usb, SIGNAL(connected()), this, SIGNAL(connected()));
 	connect(&usb, SIGNAL(disconnected()), this, SIGNAL(disconnected()));
-	usbB2union.data[0] = 0xB2;
-	usbB2union.data[8] = 0xA4;
-	usbB2union.data[9] = 0x14;
-	usbB2union.data[10] = 0x00;
-	usbB2union.data[11] = 0x00;
+	usb.setReadCallback([this](quint64 tag, const unsigned char *data, int size) {adcReceived(tag, data, size);});
+	watchdog.setInterval(STALL_CHECK_MS);
+	connect(&watchdog, &QTimer::timeout, this, &slimusb::checkStall);
+	watchdog.start();
 }
 
 bool slimusb::init(int debugLevel)
@@ -59,6 +81,8 @@ bool slimusb::init(int debugLevel)
 	setDebugLevel(debugLevel);
 	if(!usb.init((debugLevel)))
 		return false;
+	if(emulated)
+		return usb.openEmulatedDevice();
 	if(autoConnect)
 		usb.enableCallBack(true);
 	return true;
@@ -66,10 +90,8 @@ bool slimusb::init(int debugLevel)
 
 slimusb::~slimusb()
 {
-	qDeleteAll(usbData.values());
-	this->requestInterruption();
-	this->wait(1000);
-	foreach (hardwareDevice *dev, msa::getInstance().currentHardwareDevices) {
+	stopWorker();
+	foreach (hardwareDevice *dev, getInstrument().currentHardwareDevices) {
 		foreach (hardwareDevice::devicePin *pin, dev->devicePins.values()) {
 			if(pin->hwconfig)
 				delete static_cast<parallelEqui*>(pin->hwconfig);
@@ -79,27 +101,49 @@ slimusb::~slimusb()
 
 void slimusb::commandStep(quint32 step)
 {
-	if(msa::getInstance().currentInterface->getDebugLevel() > 1)
+	if(getDebugLevel() > 1)
 		qDebug()<<"step:"<< step;
-	sendUSB(*usbData.value(step), 7, false);
-	QThread::usleep(readDelay_us);
-	sendUSB(adcSend, 0, false, true);
+	const slimSweep &current = sweep();
+	quint32 slot = current.streamed ? stepPlan.slotOf(step, sweepInverted) : step;
+	// goes out in the same packet as the ADC request of the previous step
+	sendFrame(current.frames.constData() + int(slot) * current.frameSize, current.frameSize);
+	// the settle time counts from when the frame left, the previous ADC reply can still be on its way
+	if(usb.isConnected() && !usb.waitForWrites())
+		stopAcquisition();
+	if(!current.pollLock || !usb.isConnected())
+		stepPacer::wait(settleTime_us(step));
+	else {
+		QElapsedTimer settling;
+		settling.start();
+		if(!waitForLock(settleTime_us(step))) {
+			// not locked in time or no status reply, the step waits the whole write/read delay as without lock detect
+			if(getDebugLevel() > 1)
+				qDebug() << "step:" << step << "lock detect timeout";
+			qint64 left_us = qint64(readDelay_us) - settling.nsecsElapsed() / 1000;
+			if(left_us > 0)
+				stepPacer::wait((unsigned long)left_us);
+		}
+	}
+	sendUSB(current.adcSend, 0, false, true);
 	lastCommandedStep = step;
 }
 
 bool slimusb::getIsConnected() const
 {
-	return (usbdevice::deviceHandler != nullptr);
+	return usb.isConnected();
 }
 
 void slimusb::on_commandNextStep()
 {
 	commandStep(currentStep);
-	if(!msa::getInstance().getIsInverted())
+	// there is no next step to carry the ADC request
+	if(usb.isConnected())
+		usb.waitForWrites();
+	if(!sweepInverted)
 		++currentStep;
 	if(currentStep > (numberOfSteps - 1))
 		currentStep = 0;
-	if(msa::getInstance().getIsInverted()) {
+	if(sweepInverted) {
 		if(currentStep == 0)
 			currentStep = numberOfSteps -1;
 		else {
@@ -110,108 +154,105 @@ void slimusb::on_commandNextStep()
 
 void slimusb::on_commandPreviousStep()
 {
-	if(!msa::getInstance().getIsInverted()) {
+	if(!sweepInverted) {
 		if(currentStep == 0)
 			currentStep = numberOfSteps - 1;
 		else
 			--currentStep;
 	}
-	if(msa::getInstance().getIsInverted())
+	if(sweepInverted)
 		++currentStep;
 	if(currentStep > (numberOfSteps - 1))
 		currentStep = 0;
 	commandStep(currentStep);
+	if(usb.isConnected())
+		usb.waitForWrites();
 }
 
 bool slimusb::initScan()
 {
-	QList<hardwareDevice::devicePin*> dataPins;
-	int maxSize = 0;
+	scanReady = false;
+	scanReady = interface::initScan();
+	return scanReady;
+}
+
+bool slimusb::compileScan(sweepBuffer *target, const msa::scanSnapshot &scan)
+{
+	if(!interface::compileScan(target, scan))
+		return false;
 	bool error = false;
-	interface::initScan();
-	if(pll1) {
-		error |= pll1->processNewScan();
-	}
-	if(dds1) {
-		error |= dds1->processNewScan();
-	}
-	if(pll3) {
-		error |= pll3->processNewScan();
-	}
-	if(dds3) {
-		error |= dds3->processNewScan();
-	}
-	if(error)
-		msa::getInstance().currentInterface->errorOcurred(msa::MSA, "Error ocurred processing new scan", true, true);
-	qDeleteAll(usbData.values());
-	usbData.clear();
-	foreach (hardwareDevice *dev, msa::getInstance().currentHardwareDevices.values()) {
+	slimSweep *compiled = static_cast<slimSweep *>(target);
+	const msa::scanConfig &config = target->snapshot->configuration;
+	QList<planCompiler::deviceChain> chains;
+	// DDS1 depends on PLL1's PFD table and DDS3 on PLL3's, the two chains are independent
+	chains << (planCompiler::deviceChain() << pll1 << dds1);
+	chains << (planCompiler::deviceChain() << pll3 << dds3);
+	quint32 slots = stepPlan.prepare(chains, target->snapshot, [this, target](quint32 slot, quint32 count) {buildStepFrames(target, slot, count);});
+	target->streamed = stepPlan.isStreaming();
+	serializer.clear();
+	foreach (hardwareDevice *dev, getInstrument().currentHardwareDevices.values()) {
+		if(quint32(dev->getStepRegisters().size()) != slots)
+			continue;
 		foreach (hardwareDevice::devicePin *pin, dev->getDevicePins().values()) {
-			if(pin->IOtype == hardwareDevice::MAIN_DATA) {
-				dataPins.append(pin);
-				if(pin->data.contains(0) && pin->data.value(0).dataArray->size() > maxSize)
-					maxSize = pin->data.value(0).dataArray->size();
-			}
-		}
-	}
-	int delta;
-	for(quint32 step = 0; step < quint32(msa::getInstance().currentScan.steps->size()); ++step) {
-		QByteArray *arr = new QByteArray;
-		usbData.insert(step, arr);
-		for(int b = 0; b < maxSize; ++b) {
-			uint8_t byte = 0;
-			foreach (hardwareDevice::devicePin *pin, dataPins) {
-				if(!pin->hwconfig)
-					continue;
-				if(pin->data.contains(step)) {
-					delta = maxSize - pin->data.value(step).dataArray->size() + pin->data.value(step).dataMask->count(0);
-
-					if(b >= delta) {
-						byte = uint8_t((byte & (static_cast<parallelEqui*>(pin->hwconfig))->mask) | pin->data.value(step).dataArray->at(b - delta) << (static_cast<parallelEqui*>(pin->hwconfig))->pin);
-					}
-				}
-			}
-			arr->append(char(byte | msa::getInstance().getResolution_filter_bank()));
+			if((pin->IOtype == hardwareDevice::MAIN_DATA) && pin->hwconfig)
+				serializer.addLine(dev->getStepRegisters(), dev->getRegisterSize(), dev->getBitOrder(), (static_cast<parallelEqui*>(pin->hwconfig))->pin);
 		}
 	}
-//	QList<quint32>steps = usbData.keys();
-//	std::sort(steps.begin(),steps.end());
-//	foreach (quint32 step, steps) {
-//		QString str;
-//		foreach (quint8 x, *usbData.value(step)) {
-//			QString ss = QString::number(x, 16).toUpper();
-//			QString s;
-//			if(ss.length() == 1)
-//				s = "0" + ss;
-//			else
-//				s = ss;
-//			str.append(s);
-//		}
-//		//qDebug() << step << ":" << str;
-//	}
+	// all step frames have the same size, the frame of a slot is at slot * frameSize
+	QByteArray frame;
+	QVarLengthArray<char, 64> stepBytes(serializer.frameSize());
+	appendFrame(frame, stepBytes.constData(), serializer.frameSize(), 7, false);
+	target->frameSize = frame.size();
+	target->frames.fill(0, int(slots) * target->frameSize);
+	error |= stepPlan.start(firstStep(target));
+	if(error)
+		errorOcurred(msa::MSA, "Error ocurred processing new scan", true, true);
+	QByteArray &adcSend = compiled->adcSend;
 	adcSend.clear();
-	if((msa::getInstance().currentScan.configuration.scanType != ComProtocol::VNA_Rec) && (msa::getInstance().currentScan.configuration.scanType != ComProtocol::VNA_Trans)) {
+	if((config.scanType != ComProtocol::VNA_Rec) && (config.scanType != ComProtocol::VNA_Trans)) {
 		adcSend.append(char(0xB2));//TODO
 	}
 	else
 		adcSend.append(char(0xB2));
 	if(adcmag && (adcmag->getHardwareType() == hardwareDevice::AD7685)) {
-		expectedAdcSize = 16;
+		compiled->expectedAdcSize = 16;
 		adcSend.append(char(0x00));
 		adcSend.append(0x01); adcSend.append(0x10);
 	}
 	else {
 		adcSend.append(0x01);adcSend.append(0x03);adcSend.append(0x0C);
 	}
-	adcSend.append(char(msa::getInstance().currentScan.configuration.adcAveraging));
+	adcSend.append(char(config.adcAveraging));
+	// closed loop settling needs pin 14 of every PLL in use set to digital lock detect
+	const unsigned int lockDetect = static_cast<unsigned int>(lmx2326::FoLD_field::DIGITAL_LOCK_DETECT);
+	compiled->lockPort = qBound(0, config.settling.lockPort, 4);
+	compiled->lockMask = 0;
+	compiled->pollLock = config.settling.closedLoop && qobject_cast<lmx2326*>(pll1) && (config.PLL1pin14Output == lockDetect);
+	if(compiled->pollLock)
+		compiled->lockMask |= config.settling.PLL1lockMask;
+	if(compiled->pollLock && pll3) {
+		compiled->pollLock = qobject_cast<lmx2326*>(pll3) && (config.PLL3pin14Output == lockDetect);
+		compiled->lockMask |= config.settling.PLL3lockMask;
+	}
+	if(compiled->lockMask == 0)
+		compiled->pollLock = false;
 	return !error;
 }
+
+void slimusb::on_sweepActivated()
+{
+	if(usb.getEmulatedDevice() && sweep().snapshot)
+		usb.getEmulatedDevice()->setConfiguration(sweep().snapshot->configuration);
+	// the replies received so far belong to the previous scan
+	lastReceivedStep = -1;
+}
 //first load the parallelEui struct with the configuration of each device (latch,pin, etc...)
 
 void slimusb::hardwareInit()
 {
+	scanReady = false;
 	interface::hardwareInit();
-	QHash<msa::MSAdevice, hardwareDevice *> loadedDevices = msa::getInstance().currentHardwareDevices;
+	QHash<msa::MSAdevice, hardwareDevice *> loadedDevices = getInstrument().currentHardwareDevices;
 	foreach(hardwareDevice* dev, loadedDevices.values()) {
 		if((loadedDevices.key(dev) == msa::PLL1) || (loadedDevices.key(dev) == msa::PLL2) || (loadedDevices.key(dev) == msa::PLL3)) {
 			genericPLL *pll = qobject_cast<genericPLL*>(dev);
@@ -413,11 +454,16 @@ void slimusb::hardwareInit()
 			}
 		}
 	}
+	sendInitSequences();
+}
+
+void slimusb::sendInitSequences()
+{
 	int t = 0;
 	if(pll1) {
 		foreach (quint32 step, pll1->getInitIndexes()) {
 			commandInitStep(pll1, step);
-			if(msa::getInstance().currentInterface->getDebugLevel() > 2)
+			if(getDebugLevel() > 2)
 				usbToString(QByteArray(), true, 0);
 			++t;
 		}
@@ -429,7 +475,7 @@ void slimusb::hardwareInit()
 			if(debugLevel > 2)
 				qDebug() << "DDS1 step:" << t;
 			commandInitStep(dds1, step);
-			if(msa::getInstance().currentInterface->getDebugLevel() > 2)
+			if(getDebugLevel() > 2)
 				usbToString(QByteArray(), true, 0);
 			++t;
 		}
@@ -440,7 +486,7 @@ void slimusb::hardwareInit()
 			if(debugLevel > 2)
 				qDebug() << "PLL2 step:" << t;
 			commandInitStep(pll2, step);
-			if(msa::getInstance().currentInterface->getDebugLevel() > 2)
+			if(getDebugLevel() > 2)
 				usbToString(QByteArray(), true, 0);
 			++t;
 		}
@@ -451,7 +497,7 @@ void slimusb::hardwareInit()
 			if(debugLevel > 2)
 				qDebug() << "PLL3 step:" << t;
 			commandInitStep(pll3, step);
-			if(msa::getInstance().currentInterface->getDebugLevel() > 2)
+			if(getDebugLevel() > 2)
 				usbToString(QByteArray(), true, 0);
 			++t;
 		}
@@ -462,11 +508,14 @@ void slimusb::hardwareInit()
 			if(debugLevel > 2)
 				qDebug() << "DDS3 step:" << t;
 			commandInitStep(dds3, step);
-			if(msa::getInstance().currentInterface->getDebugLevel() > 2)
+			if(getDebugLevel() > 2)
 				usbToString(QByteArray(), true, 0);
 			++t;
 		}
 	}
+	// the init frames were combined into as few packets as possible
+	if(usb.isConnected())
+		usb.waitForWrites();
 }
 
 QByteArray slimusb::convertStringToByteArray(QString str) {
@@ -485,24 +534,16 @@ bool slimusb::sendArrayForDebug(QByteArray arr)
 	return s;
 }
 
-void slimusb::run()
+bool slimusb::acquireStep()
 {
-	forever {
-		if ( QThread::currentThread()->isInterruptionRequested() ) {
-			return;
-		}
-		commandStep(currentStep);
-		if(!msa::getInstance().getIsInverted())
-			++currentStep;
-		if(currentStep > (numberOfSteps - 1))//TODO was >=
-			currentStep = 0;
-		if(msa::getInstance().getIsInverted()) {
-			if(currentStep == 0)
-				currentStep = numberOfSteps - 1;
-			else
-				--currentStep;
-		}
-	}
+	pacer.stepStarting(isFirstOfSweep(currentStep));
+	commandStep(currentStep);
+	pacer.stepDone();
+	// the connection was lost, resumeAfterReconnect() picks up from the last reply received
+	if(!usb.isConnected())
+		return false;
+	currentStep = nextStep(currentStep);
+	return true;
 }
 
 void slimusb::commandInitStep(hardwareDevice *dev, quint32 step) {
@@ -573,49 +614,220 @@ void slimusb::commandInitStep(hardwareDevice *dev, quint32 step) {
 	}
 }
 
+void slimusb::appendFrame(QByteArray &buffer, const char *data, int size, uint8_t latch, bool autoClock)
+{
+	uint8_t usbLatch = latchToUSBNumber.value(latch);
+	int padding = ((usbLatch == 1) && (size == 21)) ? 3 : 0;
+	buffer.append(char(0xA0 + usbLatch));
+	buffer.append(char(size + padding));
+	buffer.append(char(autoClock));
+	for(int x = 0; x < padding; ++x)
+		buffer.append(char(0));
+	if(latch == 1) {
+		char resolutionFilter = char(resolutionFilterBank() << 5);
+		for(int x = 0; x < size; ++x)
+			buffer.append(char(data[x] | resolutionFilter));
+	}
+	else
+		buffer.append(data, size);
+}
+
+void slimusb::buildStepFrames(sweepBuffer *sweep, quint32 slot, quint32 count)
+{
+	uint8_t resolutionFilter = uint8_t(sweep->snapshot->resolution_filter_bank);
+	QVarLengthArray<char, 64> stepBytes(serializer.frameSize());
+	QByteArray frame;
+	frame.reserve(sweep->frameSize);
+	for(quint32 x = slot; x < slot + count; ++x) {
+		serializer.serialize(x, stepBytes.data(), resolutionFilter);
+		frame.resize(0);
+		appendFrame(frame, stepBytes.constData(), serializer.frameSize(), 7, false);
+		memcpy(sweep->frames.data() + int(x) * sweep->frameSize, frame.constData(), size_t(sweep->frameSize));
+	}
+}
+
+void slimusb::sendFrame(const char *frame, int size)
+{
+	if(usb.isConnected()) {
+		if(debugLevel > 2)
+			usbToString(QByteArray::fromRawData(frame, size), false, framesSent);
+		if(!usb.queueArray(frame, size)) {
+			stopAcquisition();
+		}
+	}
+	else
+		usbToString(QByteArray::fromRawData(frame, size), false, framesSent);
+	++framesSent;
+}
+
 void slimusb::sendUSB(QByteArray data, uint8_t latch, bool autoClock, bool isADC) {
-	static int temp = 0;
-	static int z = 0;
-	++z;
 	if(!isADC) {
-		int s = data.size();
-		if(latch == 1) {
-			for(char x = 0; x < s; ++x) {
-				data[x] = char(data[x] | (msa::getInstance().getResolution_filter_bank() << 5));
-			}
+		QByteArray frame;
+		appendFrame(frame, data.constData(), data.size(), latch, autoClock);
+		sendFrame(frame.constData(), frame.size());
+		return;
+	}
+	if(usb.isConnected()) {
+		// the reply is handed to adcReceived() once it arrives, tagged with the sweep and step it belongs to
+		quint64 tag = (quint64(currentSweep()) << 32) | lastCommandedStep;
+		if(!usb.queueArray(data.constData(), data.size(), sweep().expectedAdcSize, tag)) {
+			qDebug() << "There was an issue with the adc usb transfer";
 		}
-		if((latchToUSBNumber.value(latch) == 1) && (s == 21)) {
-			char x = 0;
-			data.insert(0, x);
-			data.insert(0, x);
-			data.insert(0, x);
-			s = s + 3;
+	}
+	else
+		usbToString(data, false, 0);
+}
+
+void slimusb::adcReceived(quint64 tag, const unsigned char *data, int size)
+{
+	if(tag == STATUS_TAG) {
+		QMutexLocker locker(&statusLock);
+		memcpy(statusReply, data, size_t(qMin(size, int(sizeof(statusReply)))));
+		++statusReplies;
+		statusArrived.wakeAll();
+		return;
+	}
+	// decoded on the transfer thread, only the values leave it
+	usbB2reply reply;
+	memset(&reply, 0, sizeof(reply));
+	memcpy(reply.data, data, size_t(qMin(size, int(sizeof(reply.data)))));
+	quint32 step = quint32(tag);
+	quint32 acquiredSweep = quint32(tag >> 32);
+	// replies of a sweep already replaced don't tell where the current one is
+	if(acquiredSweep == currentSweep())
+		lastReceivedStep.storeRelease(int(step));
+	lastProgress_ms.storeRelease(progressClock.elapsed());
+	publish(acquiredSweep, step, reply.command.adcMAG, reply.command.adcPhase);
+}
+bool slimusb::on_calibrateSettling(quint32 tolerance, calParser::settlingCalData &result)
+{
+	// the jumps of the scan compiled last, with the plan it was compiled from
+	if(!activeSweep() || !activeSweep()->snapshot)
+		return false;
+	const scanPlan *plan = activeSweep()->snapshot->steps.data();
+	quint32 steps = plan->size();
+	if(!usb.isConnected() || isAcquiring() || (steps < 2))
+		return false;
+	if(!usb.flush())
+		return false;
+	// representative jumps, from one step to the whole span
+	QList<quint32> offsets;
+	offsets << 1 << steps / 64 << steps / 16 << steps / 4 << steps - 1;
+	result.jumpToSettle.clear();
+	foreach (quint32 offset, offsets) {
+		if((offset == 0) || (plan->band.at(0) != plan->band.at(int(offset))))
+			continue;
+		double jump = qAbs(plan->LO1.at(int(offset)) - plan->LO1.at(0));
+		if(result.jumpToSettle.contains(jump))
+			continue;
+		qint64 settle = 0;
+		for(int x = 0; x < SETTLE_CAL_REPEATS; ++x) {
+			qint64 s = measureSettling(0, offset, tolerance);
+			if(s < 0)
+				return false;
+			settle = qMax(settle, s);
 		}
-		data.insert(0, char(autoClock));
-		data.insert(0, char(s));//delete +3
-		data.insert(0, char(0xA0 + latchToUSBNumber.value(latch)));
+		result.jumpToSettle.insert(jump, double(settle));
 	}
-	if(usb.isConnected()) {
-		if(!isADC) {
-			if(debugLevel > 2)
-				usbToString(data, false, temp);
-			if(!usb.sendArray(data)) {
-				this->requestInterruption();
-			}
+	if(result.jumpToSettle.isEmpty())
+		return false;
+	// least squares line, then raised until no measurement is above it
+	QList<double> jumps = result.jumpToSettle.keys();
+	double meanJump = 0;
+	double meanSettle = 0;
+	foreach (double j, jumps) {
+		meanJump += j;
+		meanSettle += result.jumpToSettle.value(j);
+	}
+	meanJump /= jumps.size();
+	meanSettle /= jumps.size();
+	double num = 0;
+	double den = 0;
+	foreach (double j, jumps) {
+		num += (j - meanJump) * (result.jumpToSettle.value(j) - meanSettle);
+		den += (j - meanJump) * (j - meanJump);
+	}
+	result.PLL_us_per_MHz = (den > 0) ? qMax(0.0, num / den) : 0;
+	result.minimum_us = 0;
+	foreach (double j, jumps)
+		result.minimum_us = qMax(result.minimum_us, result.jumpToSettle.value(j) - result.PLL_us_per_MHz * j);
+	result.calDate = QDateTime::currentDateTime().toString();
+	return true;
+}
+
+qint64 slimusb::measureSettling(quint32 from, quint32 to, quint32 tolerance)
+{
+	const slimSweep &current = sweep();
+	quint32 fromSlot = current.streamed ? stepPlan.slotOf(from, sweepInverted) : from;
+	// starts from a settled LO
+	sendFrame(current.frames.constData() + int(fromSlot) * current.frameSize, current.frameSize);
+	if(!usb.waitForWrites())
+		return -1;
+	QThread::usleep(readDelay_us);
+	quint32 toSlot = current.streamed ? stepPlan.slotOf(to, sweepInverted) : to;
+	sendFrame(current.frames.constData() + int(toSlot) * current.frameSize, current.frameSize);
+	if(!usb.waitForWrites())
+		return -1;
+	QElapsedTimer timer;
+	timer.start();
+	QVector<qint64> times;
+	QVector<quint32> readings;
+	usbB2reply reply;
+	forever {
+		if(!usb.sendArray(current.adcSend.constData(), current.adcSend.size(), reply.data, current.expectedAdcSize))
+			return -1;
+		times.append(timer.nsecsElapsed() / 1000);
+		readings.append(reply.command.adcMAG);
+		if(times.last() > SETTLE_CAL_TIMEOUT_US) {
+			errorOcurred(msa::MSA, QString("The ADC reading didn't settle within %1us of the jump from step %2 to step %3")
+						 .arg(SETTLE_CAL_TIMEOUT_US).arg(from).arg(to), false, false);
+			return -1;
 		}
-		else {
-			if(!usb.sendArray(data, usbB2union.data, expectedAdcSize)) {
-				qDebug() << "There was an issue with the adc usb transfer";
-			}
-			else {
-				emit dataReady(lastCommandedStep, usbB2union.command.adcMAG, usbB2union.command.adcPhase);
-			}
+		if(readings.size() < SETTLE_CAL_STABLE_READINGS)
+			continue;
+		quint32 low = readings.last();
+		quint32 high = readings.last();
+		for(int x = readings.size() - SETTLE_CAL_STABLE_READINGS; x < readings.size(); ++x) {
+			low = qMin(low, readings.at(x));
+			high = qMax(high, readings.at(x));
 		}
+		if(high - low <= tolerance)
+			break;
 	}
-	else
-		usbToString(data, false, temp);
-	++temp;
+	// settled at the first reading from which all the following stay within tolerance of the last one
+	int first = readings.size() - 1;
+	while((first > 0) && (qAbs(qint64(readings.at(first - 1)) - qint64(readings.last())) <= qint64(tolerance)))
+		--first;
+	return times.at(first);
 }
+
+bool slimusb::waitForLock(unsigned long timeout_us)
+{
+	const slimSweep &current = sweep();
+	QElapsedTimer timer;
+	timer.start();
+	size_t port = offsetof(usbB2command, port_A) + size_t(current.lockPort);
+	do {
+		quint32 polled;
+		{
+			QMutexLocker locker(&statusLock);
+			polled = statusReplies;
+		}
+		// only the request is pushed out, the reply of the previous step can still be on its way
+		if(!usb.queueArray(current.adcSend.constData(), current.adcSend.size(), current.expectedAdcSize, STATUS_TAG) || !usb.waitForWrites())
+			return false;
+		QMutexLocker locker(&statusLock);
+		while(statusReplies == polled) {
+			qint64 left_ms = (qint64(timeout_us) * 1000 - timer.nsecsElapsed() + 999999) / 1000000;
+			if((left_ms <= 0) || !statusArrived.wait(&statusLock, (unsigned long)left_ms))
+				return false;
+		}
+		if((statusReply[port] & current.lockMask) == current.lockMask)
+			return true;
+	} while(quint64(timer.nsecsElapsed()) < quint64(timeout_us) * 1000);
+	return false;
+}
+
 void slimusb::usbToString(QByteArray array, bool print, int temp) {
 	QString str;
 	foreach (char x, array) {
@@ -641,13 +853,13 @@ void slimusb::usbToString(QByteArray array, bool print, int temp) {
 	//	latchToUSBNumber.insert(2,3);
 	//	latchToUSBNumber.insert(3,0);
 	//	latchToUSBNumber.insert(4,2);
-	static uint8_t latch1 = 0;
-	static uint8_t latch2 = 0;
-	static uint8_t latch3 = 0;
-	static uint8_t latch4 = 0;
+	uint8_t &latch1 = debugLatches[0];
+	uint8_t &latch2 = debugLatches[1];
+	uint8_t &latch3 = debugLatches[2];
+	uint8_t &latch4 = debugLatches[3];
 	QString autoClk;
 	uint8_t *latch = nullptr;
-	static QStringList list;
+	QStringList &list = debugLines;
 	if(array.length() > 0) {
 		if((array.at(0) & 0xA0) == 0xA0) {
 			if((array.at(0) & 0x0F) == 0x00) {
@@ -700,26 +912,87 @@ QString slimusb::byteToString(uint8_t byte) {
 	return str;
 }
 
-void slimusb::on_autoscan()
+bool slimusb::resumeAfterReconnect()
 {
-	this->start();
+	if(!scanReady || !usb.isConnected())
+		return false;
+	// the acquisition stops by itself on the failed transfer, the step in progress is waited for
+	if(!postCommand(command_pause, true))
+		return false;
+	sendInitSequences();
+	// the replies lost with the connection are acquired again
+	int received = lastReceivedStep.loadAcquire();
+	if((received >= 0) && (quint32(received) < numberOfSteps))
+		currentStep = nextStep(quint32(received));
+	lastProgress_ms.storeRelease(progressClock.elapsed());
+	if(currentStatus == status_scanning)
+		postCommand(command_run, false);
+	return true;
 }
 
-void slimusb::on_pausescan()
+void slimusb::setTransferTimeouts(unsigned int write_ms, unsigned int read_ms, unsigned int stall_ms)
+{
+	usb.setTimeouts(write_ms, read_ms);
+	stallTimeout_ms = stall_ms;
+}
+
+void slimusb::checkStall()
 {
-	this->requestInterruption();
-	this->wait(1000);
+	if((currentStatus != status_scanning) || !scanReady || !usb.isConnected() || (stallTimeout_ms == 0))
+		return;
+	// slow sweeps spend their step time waiting on purpose
+	qint64 limit = stallTimeout_ms + qint64(readDelay_us / 1000) + qint64(activeSweep()->sweepTime_us / 1000 / qMax(numberOfSteps.load(), quint32(1)));
+	qint64 idle = progressClock.elapsed() - lastProgress_ms.loadAcquire();
+	// the acquisition also stops by itself after a transfer missed its deadline
+	if(isAcquiring() && (idle < limit))
+		return;
+	++stalls;
+	usbdevice::transferCounters counters = usb.getCounters();
+	errorOcurred(msa::MSA, QString("Acquisition stalled after step %1, restarting it (stalls:%2 timeouts:%3 short reads:%4)")
+				 .arg(lastReceivedStep.loadAcquire()).arg(stalls).arg(counters.timeouts).arg(counters.shortReads), false, true);
+	// wakes up the acquisition thread if it is waiting for a transfer
+	usb.stopTransfers();
+	if(!postCommand(command_pause, true))
+		return;
+	usb.stopTransfers();
+	lastProgress_ms.storeRelease(progressClock.elapsed());
+	resumeAfterReconnect();
+}
+
+void slimusb::abortStep()
+{
+	// the step can be waiting on a transfer up to its deadline, it is cancelled instead
+	usb.stopTransfers();
+}
+
+void slimusb::on_autoscan()
+{
+	// the watchdog counts from the restart
+	lastProgress_ms.storeRelease(progressClock.elapsed());
 }
 
 void slimusb::on_resumescan()
 {
-	this->start();
+	lastProgress_ms.storeRelease(progressClock.elapsed());
+}
+
+void slimusb::on_pausescan()
+{
+	// delivers the replies still in flight
+	if(usb.isConnected())
+		usb.flush();
 }
 
 void slimusb::on_cancelscan()
 {
-	this->requestInterruption();
-	this->wait(1000);
+	if(usb.isConnected())
+		usb.flush();
+}
+
+void slimusb::on_acquisitionStopped()
+{
+	// no chunk is compiled in the background while halted, the instrument may rebuild the plans
+	stepPlan.stop();
 }
 
 bool slimusb::getAutoConnect() const
@@ -730,13 +1003,16 @@ bool slimusb::getAutoConnect() const
 void slimusb::setAutoConnect(bool value)
 {
 	autoConnect = value;
-	usb.enableCallBack(autoConnect);
+	if(!emulated)
+		usb.enableCallBack(autoConnect);
 }
 
 void slimusb::printUSBData(quint32 step) {
 	QString str;
-	unsigned char *data = reinterpret_cast<unsigned char*>(usbData.value(step)->data());
-	for(int i = 0; i < usbData.value(step)->length(); ++i) {
+	const slimSweep &current = sweep();
+	quint32 slot = current.streamed ? stepPlan.slotOf(step, sweepInverted) : step;
+	const unsigned char *data = reinterpret_cast<const unsigned char*>(current.frames.constData() + int(slot) * current.frameSize);
+	for(int i = 0; i < current.frameSize; ++i) {
 		QString d = QString::number(data[i], 16);
 		if(d.length() == 1)
 			d.insert(0,"0");
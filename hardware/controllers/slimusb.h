@@ -28,6 +28,11 @@
 
 #include <QObject>
 #include <QThread>
+#include <QElapsedTimer>
+#include <QAtomicInt>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QTimer>
 #include <QVector>
 #include "interface.h"
 #include <QHash>
@@ -37,12 +42,15 @@
 #include "../genericadc.h"
 
 #include "usbdevice.h"
+#include "../planstream.h"
+#include "../registerserializer.h"
 
 class slimusb : public interface
 {
 	Q_OBJECT
 public:
-	slimusb(QObject *parent);
+	// emulated: talks to an in-process emulation of the SLIM firmware instead of the USB device
+	slimusb(QObject *parent, bool emulated = false, msa *instrument = nullptr);
 	bool init(int debugLevel);
 	~slimusb();
 	QList<usbdevice::usbDevice_t> getDevices();
@@ -55,13 +63,33 @@ public:
 	void hardwareInit();
 	QByteArray convertStringToByteArray(QString str);
 	bool sendArrayForDebug(QByteArray);
-	interface_types type() {return USB;}
+	interface_types type() {return emulated ? EMULATOR : USB;}
+	bool resumeAfterReconnect();
+	void setTransferTimeouts(unsigned int write_ms, unsigned int read_ms, unsigned int stall_ms);
 protected:
-	void run();
+	// the ADC request and the closed loop settling settings change with the scan too
+	class slimSweep: public sweepBuffer
+	{
+	public:
+		QByteArray adcSend;
+		int expectedAdcSize;
+		// closed loop settling, the ADC request is also used to read the status ports
+		bool pollLock;
+		int lockPort;
+		uint8_t lockMask;
+	};
+	sweepBuffer *createSweepBuffer() {return new slimSweep;}
+	bool on_calibrateSettling(quint32 tolerance, calParser::settlingCalData &result);
+	bool compileScan(sweepBuffer *target, const msa::scanSnapshot &scan);
+	void on_sweepActivated();
+	const slimSweep &sweep() const {return *static_cast<const slimSweep *>(activeSweep());}
+	bool acquireStep();
+	void abortStep();
 	void on_autoscan();
-	void on_pausescan();
 	void on_resumescan();
+	void on_pausescan();
 	void on_cancelscan();
+	void on_acquisitionStopped();
 	void on_commandNextStep();
 	void on_commandPreviousStep();
 	void on_setWriteReadDelay_us(unsigned long value);
@@ -81,10 +109,11 @@ private:
 		quint32 adcMAG;
 		quint32 adcPhase;
 	} usbB2command;
-	union {
+	// reply to the ADC request, each reader decodes into its own
+	typedef union {
 		usbB2command command;
 		unsigned char data[16];
-	} usbB2union;
+	} usbB2reply;
 	usbdevice usb;
 	typedef struct {
 		uint8_t latch;
@@ -93,6 +122,7 @@ private:
 	} parallelEqui;
 	QHash<msa::MSAdevice, QHash<hardwareDevice::HWdevice, parallelEqui>> pinMapping;
 	bool autoConnect;
+	bool emulated;
 	bool singleStep;
 	parallelEqui *pll1data;
 	parallelEqui *pll1le;
@@ -118,14 +148,51 @@ private:
 	QHash<uint8_t, uint8_t> latchToUSBNumber;
 	void commandStep(quint32 step);
 	void commandInitStep(hardwareDevice *dev, quint32 step);
+	// programs the devices with their init sequences, the device registers are lost with the power
+	void sendInitSequences();
 	void sendUSB(QByteArray data, uint8_t latch, bool autoClock, bool isADC = false);
+	// called from the usb transfer thread with the reply to an ADC request, tag holds the sweep
+	// number in the high 32 bits and the step in the low ones
+	void adcReceived(quint64 tag, const unsigned char *data, int size);
+	// appends the complete wire frame (0xA0+latch header, padding and data) to buffer
+	void appendFrame(QByteArray &buffer, const char *data, int size, uint8_t latch, bool autoClock);
+	void sendFrame(const char *frame, int size);
 	QString byteToString(uint8_t byte);
 	QString constructString(uint8_t latch1, uint8_t latch2, uint8_t latch3, uint8_t latch4, QString clock);
 	void usbToString(QByteArray array, bool print, int temp);
-	QHash<quint32, QByteArray *> usbData;
+	// debug trace state of usbToString, the latches as the frames leave them
+	int framesSent;
+	uint8_t debugLatches[4];
+	QStringList debugLines;
+	// compiles the device plans, streamed ahead of the acquisition for large scans
+	planStream stepPlan;
+	registerSerializer serializer;
+	// fills the wire frames of count slots of sweep, called by stepPlan once their registers are compiled
+	void buildStepFrames(sweepBuffer *sweep, quint32 slot, quint32 count);
 	void printUSBData(quint32 step);
-	QByteArray adcSend;
-	int expectedAdcSize;
+	// the step plan and frames of the current scan are compiled and can be resumed
+	bool scanReady;
+	// step of the last ADC reply received, -1 if none since the scan was compiled
+	QAtomicInt lastReceivedStep;
+	// restarts the acquisition when no ADC reply arrived for stallTimeout_ms while scanning
+	QTimer watchdog;
+	QElapsedTimer progressClock;
+	QAtomicInteger<qint64> lastProgress_ms;
+	unsigned int stallTimeout_ms;
+	quint32 stalls;
+	void checkStall();
+	// last status reply and number of them received, written by the usb transfer thread
+	QMutex statusLock;
+	QWaitCondition statusArrived;
+	unsigned char statusReply[16];
+	quint32 statusReplies;
+	// polls the lock detect until all the PLLs in use are locked, false on timeout or USB error
+	bool waitForLock(unsigned long timeout_us);
+	// tag of the status polls, the sweeps are numbered from 1 so no ADC reply has it
+	static const quint64 STATUS_TAG = 0x80000000;
+	// time in us the ADC reading takes to converge after jumping from step from to step to,
+	// -1 on errors and when it doesn't converge within SETTLE_CAL_TIMEOUT_US
+	qint64 measureSettling(quint32 from, quint32 to, quint32 tolerance);
 };
 
 #endif // SLIMUSB_H
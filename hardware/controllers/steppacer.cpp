@@ -0,0 +1,86 @@
+/**
+ ******************************************************************************
+ *
+ * @file       main.cpp
+ * @author     Jose Barros (AKA PT_Dreamer) josemanuelbarros@gmail.com 2019
+ * @brief      steppacer.cpp file
+ * @see        The GNU Public License (GPL) Version 3
+ * @defgroup   stepPacer
+ * @{
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+#include "steppacer.h"
+#include <thread>
+#ifdef Q_OS_LINUX
+#include <time.h>
+#include <errno.h>
+#endif
+
+stepPacer::stepPacer():sweepTime_us(0), steps(0), stepsDone(0)
+{
+}
+
+void stepPacer::wait(unsigned long us)
+{
+	waitUntil(clock::now() + std::chrono::microseconds(us));
+}
+
+void stepPacer::waitUntil(stepPacer::clock::time_point deadline)
+{
+	clock::time_point wake = deadline - std::chrono::microseconds(PACER_SPIN_US);
+	clock::time_point now = clock::now();
+	if(now < wake) {
+#ifdef Q_OS_LINUX
+		std::chrono::nanoseconds coarse = wake - now;
+		timespec t;
+		t.tv_sec = time_t(coarse.count() / 1000000000);
+		t.tv_nsec = long(coarse.count() % 1000000000);
+		// relative to CLOCK_MONOTONIC, as steady_clock is, restarted with the remaining time when interrupted
+		while(clock_nanosleep(CLOCK_MONOTONIC, 0, &t, &t) == EINTR) {}
+#else
+		std::this_thread::sleep_until(wake);
+#endif
+	}
+	while(clock::now() < deadline) {}
+}
+
+void stepPacer::setSweepTime(quint64 sweepTime_us, quint32 steps)
+{
+	this->sweepTime_us = steps ? sweepTime_us : 0;
+	this->steps = steps;
+	// the next step restarts the sweep timing
+	stepsDone = steps;
+}
+
+void stepPacer::stepStarting(bool firstOfSweep)
+{
+	if(!sweepTime_us)
+		return;
+	if(firstOfSweep || (stepsDone >= steps)) {
+		sweepStart = clock::now();
+		stepsDone = 0;
+	}
+}
+
+void stepPacer::stepDone()
+{
+	if(!sweepTime_us)
+		return;
+	++stepsDone;
+	// the deadlines are absolute, a late step is made up by the following ones
+	waitUntil(sweepStart + std::chrono::microseconds(sweepTime_us * stepsDone / steps));
+}
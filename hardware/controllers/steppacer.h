@@ -0,0 +1,61 @@
+/**
+ ******************************************************************************
+ *
+ * @file       main.cpp
+ * @author     Jose Barros (AKA PT_Dreamer) josemanuelbarros@gmail.com 2019
+ * @brief      steppacer.h file
+ * @see        The GNU Public License (GPL) Version 3
+ * @defgroup   stepPacer
+ * @{
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef STEPPACER_H
+#define STEPPACER_H
+
+#include <QtGlobal>
+#include <chrono>
+
+// the last microseconds of a wait are spent spinning, the scheduler wakes us up too late for them
+#define PACER_SPIN_US 50
+
+// Paces the steps of the acquisition thread.
+// Waits sleep for the bulk of the time and spin on the steady clock for the end,
+// so short waits are not stretched by the scheduler wake up latency.
+// In fixed sweep time mode every step of the sweep also ends at its share of the sweep time.
+class stepPacer
+{
+public:
+	typedef std::chrono::steady_clock clock;
+	stepPacer();
+	// waits us microseconds from now
+	static void wait(unsigned long us);
+	static void waitUntil(clock::time_point deadline);
+	// spreads sweepTime_us evenly over steps, 0 paces the steps by their settle times only
+	void setSweepTime(quint64 sweepTime_us, quint32 steps);
+	bool isFixedSweepTime() const {return sweepTime_us != 0;}
+	// called before a step is commanded, the first step of the sweep restarts the sweep timing
+	void stepStarting(bool firstOfSweep);
+	// called once the step was commanded, waits for the end of its share of the sweep time
+	void stepDone();
+private:
+	quint64 sweepTime_us;
+	quint32 steps;
+	quint32 stepsDone;
+	clock::time_point sweepStart;
+};
+
+#endif // STEPPACER_H
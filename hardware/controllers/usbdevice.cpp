@@ -25,9 +25,8 @@
  */
 #include "usbdevice.h"
 
-libusb_device_handle *usbdevice::deviceHandler = NULL;
-
-usbdevice::usbdevice(QObject *parent) : QObject(parent),devs(NULL)
+usbdevice::usbdevice(QObject *parent) : QObject(parent),devs(NULL),deviceHandler(nullptr),handleUsers(0),handlerContext(NULL),callbackEnabled(false),hotplugChecked(false),maxWrites(USB_WRITES_IN_FLIGHT),maxReads(USB_READS_IN_FLIGHT),
+	transfersStarted(false),transfersStopping(false),maxPacketSize(USB_DEFAULT_PACKET_SIZE),transferError(false),transferTimedOut(false),writeTimeout_ms(USB_WRITE_TIMEOUT_MS),readTimeout_ms(USB_READ_TIMEOUT_MS),emulated(nullptr)
 {
 	connect(this, SIGNAL(closeWorker()), &worker, SLOT(quit()));
 }
@@ -48,10 +47,9 @@ usbdevice::~usbdevice()
 {
 	enableCallBack(false);
 	worker.wait(1000);
-	if(deviceHandler) {
-		libusb_close(deviceHandler);
-		//qDebug() << "closing device";
-	}
+	stopTransfers();
+	delete emulated;
+	closeHandle();
 	libusb_free_device_list(devs, 1); //free the list, unref the devices in it
 	libusb_exit(ctx);
 	//qDebug()<< "end destructor";
@@ -60,24 +58,39 @@ usbdevice::~usbdevice()
 
 bool usbdevice::openDevice(int deviceNumber)
 {
-	libusb_open(devs[deviceNumber], &deviceHandler);
-	int r = libusb_claim_interface(deviceHandler, 0); //claim interface 0 (the first) of device (mine had jsut 1)
+	libusb_device_handle *handle = nullptr;
+	libusb_open(devs[deviceNumber], &handle);
+	if(!handle)
+		return false;
+	int r = libusb_claim_interface(handle, 0); //claim interface 0 (the first) of device (mine had jsut 1)
 	if(r < 0) {
 		cout<<"Cannot Claim Interface"<<endl;
+		libusb_close(handle);
 		return false;
 	}
-	if(deviceHandler) {
-		//qDebug() << "USB device connected";
-		emit connected();
-		return true;
-	}
-	else
-		return false;
+	setHandle(handle, ctx);
+	//qDebug() << "USB device connected";
+	emit connected();
+	return true;
+}
+
+bool usbdevice::openEmulatedDevice()
+{
+	if(!emulated)
+		emulated = new slimEmulator;
+	emit connected();
+	return true;
 }
 
 void usbdevice::closeDevice()
 {
-	libusb_close(deviceHandler);
+	stopTransfers();
+	if(emulated) {
+		delete emulated;
+		emulated = nullptr;
+	}
+	else
+		closeHandle();
 	emit disconnected();
 }
 
@@ -178,21 +191,18 @@ void usbdevice::printdev(libusb_device *dev) {
 
 int usbdevice::enableCallBack(bool enable)
 {
-	static libusb_hotplug_callback_handle handle;
-	static bool callbackEnabled = false;
-	static bool once = true;
-	if(once) {
+	if(!hotplugChecked) {
 		if(!isHotPlugCapable())
 			return false;
 	}
-	once = false;
+	hotplugChecked = true;
 	if(enable && !callbackEnabled) {
 		int rc;
 		libusb_init(nullptr);
 		rc = libusb_hotplug_register_callback(nullptr, libusb_hotplug_event(LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED |
 																		   LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT), libusb_hotplug_flag(LIBUSB_HOTPLUG_ENUMERATE), G8_VID, G8_PID,
 											  LIBUSB_HOTPLUG_MATCH_ANY, libusb_hotplug_callback_fn(usbdevice::hotplug_callback), this,
-											  &handle);
+											  &hotplugHandle);
 		if (LIBUSB_SUCCESS != rc) {
 			printf("Error creating a hotplug callback\n");
 			libusb_exit(nullptr);
@@ -211,7 +221,7 @@ int usbdevice::enableCallBack(bool enable)
 		if(w)
 			w->quit();
 		worker.quit();
-		libusb_hotplug_deregister_callback(nullptr, handle);
+		libusb_hotplug_deregister_callback(nullptr, hotplugHandle);
 		libusb_exit(nullptr);
 		callbackEnabled = false;
 		return true;
@@ -220,97 +230,521 @@ int usbdevice::enableCallBack(bool enable)
 }
 
 bool usbdevice::sendArray(QByteArray data, unsigned char* receivedData, int expectedSize) {
-	if(!usbdevice::deviceHandler) {
+	return sendArray(data.constData(), data.size(), receivedData, expectedSize);
+}
+
+bool usbdevice::sendArray(const char *data, int size, unsigned char* receivedData, int expectedSize) {
+	if(emulated) {
+		emulated->write(reinterpret_cast<const unsigned char*>(data), size);
+		return emulated->read(receivedData, expectedSize) == expectedSize;
+	}
+	libusb_device_handle *handle = takeHandle();
+	if(!handle) {
 		return false;
 	}
 	int actual;
-	int r = libusb_bulk_transfer(deviceHandler, (2 | LIBUSB_ENDPOINT_OUT), reinterpret_cast<unsigned char*>(data.data()), data.size(), &actual, 0);
+	int r = libusb_bulk_transfer(handle, (2 | LIBUSB_ENDPOINT_OUT), reinterpret_cast<unsigned char*>(const_cast<char*>(data)), size, &actual, writeTimeout_ms);
+	if(r == LIBUSB_ERROR_TIMEOUT) {
+		timeouts.ref();
+		giveHandle();
+		return false;
+	}
 	if(r != 0)
 	{
-		if(usbdevice::deviceHandler)
-			libusb_close(usbdevice::deviceHandler);
-		usbdevice::deviceHandler = NULL;
+		giveHandle();
+		closeHandle();
 		//qDebug() << "NOT reveived ADC2";
 		emit disconnected();
 		return false;
 	}
-	for(int x = 0; x < 10; ++x) {
-		r = libusb_bulk_transfer(deviceHandler, (6 | LIBUSB_ENDPOINT_IN), receivedData, expectedSize, &actual, 0);
+	QElapsedTimer started;
+	started.start();
+	for(int x = 0; x < USB_READ_RETRIES; ++x) {
+		unsigned int remaining;
+		if(!remainingTime(started, readTimeout_ms, &remaining))
+			r = LIBUSB_ERROR_TIMEOUT;
+		else
+			r = libusb_bulk_transfer(handle, (6 | LIBUSB_ENDPOINT_IN), receivedData, expectedSize, &actual, remaining);
+		if(r == LIBUSB_ERROR_TIMEOUT) {
+			timeouts.ref();
+			giveHandle();
+			return false;
+		}
 		if(r != 0)
 		{
-			if(usbdevice::deviceHandler)
-				libusb_close(usbdevice::deviceHandler);
-			usbdevice::deviceHandler = NULL;
+			giveHandle();
+			closeHandle();
 			emit disconnected();
 			//qDebug() << "NOT reveived ADC2" << r;
 			Q_ASSERT(false);
 			return false;
 		}
 		else if(actual == expectedSize) {
+			giveHandle();
 			return true;
 		}
-		else if(x > 5)
+		shortReads.ref();
+		if(x > 5)
 			qDebug() << "actual" << actual << "expected" << expectedSize;
 	}
+	giveHandle();
 	qDebug() << "NOT reveived ADC3";
 	return false;
 }
 
 bool usbdevice::sendArray(QByteArray data)
 {
-	if(!usbdevice::deviceHandler)
+	return sendArray(data.constData(), data.size());
+}
+
+bool usbdevice::sendArray(const char *data, int size)
+{
+	if(emulated) {
+		emulated->write(reinterpret_cast<const unsigned char*>(data), size);
+		return true;
+	}
+	libusb_device_handle *handle = takeHandle();
+	if(!handle)
 		return false;
 	int actual;
-	int r = libusb_bulk_transfer(deviceHandler, (2 | LIBUSB_ENDPOINT_OUT), reinterpret_cast<unsigned char*>(data.data()), data.size(), &actual, 0);
+	int r = libusb_bulk_transfer(handle, (2 | LIBUSB_ENDPOINT_OUT), reinterpret_cast<unsigned char*>(const_cast<char*>(data)), size, &actual, writeTimeout_ms);
+	giveHandle();
+	if(r == LIBUSB_ERROR_TIMEOUT) {
+		timeouts.ref();
+		return false;
+	}
 	if(r != 0)
 	{
-		if(usbdevice::deviceHandler)
-			libusb_close(usbdevice::deviceHandler);
-		usbdevice::deviceHandler = nullptr;
+		closeHandle();
 		emit disconnected();
 		return false;
 	}
 	return true;
 }
 
+void usbdevice::setReadCallback(usbdevice::readCallback callback)
+{
+	QMutexLocker locker(&transferMutex);
+	onRead = callback;
+}
+
+void usbdevice::setTransfersInFlight(int writes, int reads)
+{
+	stopTransfers();
+	QMutexLocker locker(&transferMutex);
+	maxWrites = qMax(1, writes);
+	maxReads = qMax(1, reads);
+}
+
+bool usbdevice::queueArray(const char *data, int size)
+{
+	QMutexLocker locker(&transferMutex);
+	if(combineWrite(data, size))
+		return true;
+	locker.unlock();
+	transferFailed();
+	return false;
+}
+
+bool usbdevice::queueArray(const char *data, int size, int expectedSize, quint64 tag)
+{
+	QMutexLocker locker(&transferMutex);
+	if(combineWrite(data, size)) {
+		// the request leaves now, with the writes combined before it, and not with the next
+		// step: the read timeout runs from here while the caller may be pacing the sweep
+		transferSlot *read = submitPending() ? takeTransfer(freeReads) : nullptr;
+		if(read) {
+			read->buffer.fill(0, expectedSize);
+			read->expectedSize = expectedSize;
+			read->tag = tag;
+			read->retries = 0;
+			read->submitted.start();
+			if(submitTransfer(read, (6 | LIBUSB_ENDPOINT_IN), expectedSize))
+				return true;
+		}
+	}
+	locker.unlock();
+	transferFailed();
+	return false;
+}
+
+bool usbdevice::waitForWrites()
+{
+	QMutexLocker locker(&transferMutex);
+	if(submitPending() && waitForIdle(false))
+		return true;
+	locker.unlock();
+	transferFailed();
+	return false;
+}
+
+bool usbdevice::flush()
+{
+	QMutexLocker locker(&transferMutex);
+	if(submitPending() && waitForIdle(true))
+		return true;
+	locker.unlock();
+	transferFailed();
+	return false;
+}
+
+void usbdevice::stopTransfers()
+{
+	QMutexLocker locker(&transferMutex);
+	if(!transfersStarted)
+		return;
+	// another thread is stopping them, the slots are freed by it
+	if(transfersStopping) {
+		while(transfersStarted)
+			transferDone.wait(&transferMutex);
+		return;
+	}
+	transfersStopping = true;
+	// the emulated writes complete when submitted, only the reads can be waiting
+	freeReads.append(emulatedReads);
+	emulatedReads.clear();
+	foreach (transferSlot *slot, transferSlots) {
+		if(!freeWrites.contains(slot) && !freeReads.contains(slot))
+			libusb_cancel_transfer(slot->transfer);
+	}
+	// the transfers are only freed once their callback returned them, libusb completes the cancelled
+	// ones (and those of a device that is gone) on the transfer thread, which must not be this one
+	Q_ASSERT(QThread::currentThread() != &transferThread);
+	while(freeWrites.size() + freeReads.size() < transferSlots.size()) {
+		if(!transferDone.wait(&transferMutex, 1000))
+			qDebug() << "waiting for the cancelled USB transfers to complete";
+	}
+	// the transfer thread can be waiting for the mutex in a callback
+	locker.unlock();
+	transferThread.requestInterruption();
+	transferThread.wait();
+	locker.relock();
+	foreach (transferSlot *slot, transferSlots) {
+		libusb_free_transfer(slot->transfer);
+		delete slot;
+	}
+	transferSlots.clear();
+	freeWrites.clear();
+	freeReads.clear();
+	pendingWrite.clear();
+	transfersStarted = false;
+	transfersStopping = false;
+	transferError = false;
+	transferTimedOut = false;
+	// wakes up whoever was waiting for a transfer, they find the transfers stopped
+	transferDone.wakeAll();
+}
+
+bool usbdevice::startTransfers()
+{
+	if(transfersStarted)
+		return !transfersStopping;
+	if(!isConnected())
+		return false;
+	for(int x = 0; x < maxWrites + maxReads; ++x) {
+		transferSlot *slot = new transferSlot;
+		slot->owner = this;
+		slot->transfer = libusb_alloc_transfer(0);
+		slot->tag = 0;
+		slot->expectedSize = 0;
+		slot->retries = 0;
+		transferSlots.append(slot);
+		if(x < maxWrites)
+			freeWrites.append(slot);
+		else
+			freeReads.append(slot);
+	}
+	int packetSize = emulated ? USB_DEFAULT_PACKET_SIZE : libusb_get_max_packet_size(libusb_get_device(deviceHandler.loadAcquire()), (2 | LIBUSB_ENDPOINT_OUT));
+	maxPacketSize = (packetSize > 0) ? packetSize : USB_DEFAULT_PACKET_SIZE;
+	pendingWrite.clear();
+	pendingWrite.reserve(maxPacketSize);
+	transferError = false;
+	transferTimedOut = false;
+	transfersStarted = true;
+	// the emulated transfers complete on the caller's thread
+	if(emulated)
+		return true;
+	transferThread.setContext(handlerContext);
+	transferThread.start(QThread::TimeCriticalPriority);
+	return true;
+}
+
+usbdevice::transferSlot *usbdevice::takeTransfer(QList<usbdevice::transferSlot *> &pool)
+{
+	if(!startTransfers())
+		return nullptr;
+	while(pool.isEmpty() && transfersStarted && !transfersStopping && !transferError && isConnected())
+		transferDone.wait(&transferMutex);
+	if(!transfersStarted || transfersStopping || transferError || !isConnected())
+		return nullptr;
+	return pool.takeFirst();
+}
+
+bool usbdevice::combineWrite(const char *data, int size)
+{
+	if(!startTransfers())
+		return false;
+	if(!pendingWrite.isEmpty() && (pendingWrite.size() + size > maxPacketSize) && !submitPending())
+		return false;
+	pendingWrite.append(data, size);
+	// a full packet gains nothing from waiting
+	if(pendingWrite.size() >= maxPacketSize)
+		return submitPending();
+	return true;
+}
+
+bool usbdevice::submitPending()
+{
+	if(pendingWrite.isEmpty())
+		return transfersStarted || isConnected();
+	transferSlot *slot = takeTransfer(freeWrites);
+	if(!slot)
+		return false;
+	slot->buffer = pendingWrite;
+	pendingWrite.clear();
+	return submitTransfer(slot, (2 | LIBUSB_ENDPOINT_OUT), slot->buffer.size());
+}
+
+bool usbdevice::submitTransfer(usbdevice::transferSlot *slot, unsigned char endpoint, int size)
+{
+	if(emulated) {
+		if(endpoint & LIBUSB_ENDPOINT_IN)
+			emulatedReads.append(slot);
+		else {
+			emulated->write(reinterpret_cast<const unsigned char*>(slot->buffer.constData()), size);
+			freeWrites.append(slot);
+		}
+		deliverEmulatedReads();
+		transferDone.wakeAll();
+		return true;
+	}
+	libusb_fill_bulk_transfer(slot->transfer, deviceHandler.loadAcquire(), endpoint, reinterpret_cast<unsigned char*>(slot->buffer.data()), size,
+							  usbdevice::transferCallback, slot, (endpoint & LIBUSB_ENDPOINT_IN) ? readTimeout_ms : writeTimeout_ms);
+	if(deviceHandler.loadAcquire() && (libusb_submit_transfer(slot->transfer) == 0))
+		return true;
+	transferError = true;
+	if(endpoint & LIBUSB_ENDPOINT_IN)
+		freeReads.append(slot);
+	else
+		freeWrites.append(slot);
+	return false;
+}
+
+bool usbdevice::waitForIdle(bool readsToo)
+{
+	if(!transfersStarted)
+		return isConnected();
+	while(transfersStarted && !transferError && ((freeWrites.size() < maxWrites) || (readsToo && (freeReads.size() < maxReads))))
+		transferDone.wait(&transferMutex);
+	return !transferError;
+}
+
+void usbdevice::deliverEmulatedReads()
+{
+	// the replies come in request order, as on the bus
+	while(!emulatedReads.isEmpty() && emulated->hasReply()) {
+		transferSlot *slot = emulatedReads.takeFirst();
+		unsigned char *buffer = reinterpret_cast<unsigned char*>(slot->buffer.data());
+		int actual = emulated->read(buffer, slot->expectedSize);
+		if(actual != slot->expectedSize)
+			qDebug() << "actual" << actual << "expected" << slot->expectedSize;
+		else if(onRead)
+			onRead(slot->tag, buffer, actual);
+		freeReads.append(slot);
+	}
+}
+
+void usbdevice::setTimeouts(unsigned int write_ms, unsigned int read_ms)
+{
+	QMutexLocker locker(&transferMutex);
+	writeTimeout_ms = write_ms;
+	readTimeout_ms = read_ms;
+}
+
+usbdevice::transferCounters usbdevice::getCounters() const
+{
+	transferCounters c;
+	c.timeouts = quint32(timeouts.loadAcquire());
+	c.shortReads = quint32(shortReads.loadAcquire());
+	return c;
+}
+
+bool usbdevice::remainingTime(const QElapsedTimer &started, unsigned int timeout_ms, unsigned int *remaining)
+{
+	*remaining = 0;
+	if(timeout_ms == 0)
+		return true;
+	qint64 left = qint64(timeout_ms) - started.elapsed();
+	if(left <= 0)
+		return false;
+	*remaining = static_cast<unsigned int>(left);
+	return true;
+}
+
+void usbdevice::transferFailed()
+{
+	transferMutex.lock();
+	// transfers stopped from another thread or a missed deadline leave the device usable
+	bool deviceLost = transferError && !transferTimedOut;
+	transferMutex.unlock();
+	if(!deviceLost) {
+		stopTransfers();
+		return;
+	}
+	closeHandle();
+	emit disconnected();
+}
+
+void LIBUSB_CALL usbdevice::transferCallback(libusb_transfer *transfer)
+{
+	transferSlot *slot = static_cast<transferSlot *>(transfer->user_data);
+	usbdevice *th = slot->owner;
+	bool isRead = transfer->endpoint & LIBUSB_ENDPOINT_IN;
+	bool failed = (transfer->status != LIBUSB_TRANSFER_COMPLETED) && (transfer->status != LIBUSB_TRANSFER_CANCELLED);
+	bool timedOut = transfer->status == LIBUSB_TRANSFER_TIMED_OUT;
+	if(isRead && (transfer->status == LIBUSB_TRANSFER_COMPLETED)) {
+		if(transfer->actual_length == slot->expectedSize) {
+			if(th->onRead)
+				th->onRead(slot->tag, transfer->buffer, transfer->actual_length);
+		}
+		else if(++slot->retries < USB_READ_RETRIES) {
+			th->shortReads.ref();
+			if(slot->retries > 5)
+				qDebug() << "actual" << transfer->actual_length << "expected" << slot->expectedSize;
+			unsigned int remaining;
+			if(!remainingTime(slot->submitted, th->readTimeout_ms, &remaining))
+				timedOut = failed = true;
+			else {
+				transfer->timeout = remaining;
+				if(libusb_submit_transfer(transfer) == 0)
+					return;
+				failed = true;
+			}
+		}
+		else
+			qDebug() << "NOT reveived ADC3";
+	}
+	if(timedOut)
+		th->timeouts.ref();
+	QMutexLocker locker(&th->transferMutex);
+	if(failed)
+		th->transferError = true;
+	if(timedOut)
+		th->transferTimedOut = true;
+	if(isRead)
+		th->freeReads.append(slot);
+	else
+		th->freeWrites.append(slot);
+	th->transferDone.wakeAll();
+}
+
 int LIBUSB_CALL usbdevice::hotplug_callback(struct libusb_context *ctx, struct libusb_device *dev, libusb_hotplug_event event, void *user_data) {
 	Q_UNUSED(ctx)
-	Q_UNUSED(user_data)
 	usbdevice *th = static_cast<usbdevice*>(user_data);
-	struct libusb_device_descriptor desc;
-	int rc;
-	(void)libusb_get_device_descriptor(dev, &desc);
+	if(!th)
+		return 0;
+	// called by whichever thread handles the events, possibly the transfer thread itself,
+	// which can neither wait for its own transfers nor do synchronous requests: the work
+	// is done on the thread of the device object
 	if (LIBUSB_HOTPLUG_EVENT_DEVICE_ARRIVED == event) {
-		rc = libusb_open(dev, &deviceHandler);
-		int r;
-		r = libusb_claim_interface(deviceHandler, 0); //claim interface 0 (the first) of device (mine had jsut 1)
-		if(r < 0) {
-			cout<<"Cannot Claim Interface"<<endl;
-			return 1;
-		}
-		cout<<"Claimed Interface"<<endl;
-		if (LIBUSB_SUCCESS != rc) {
-			//qDebug()<<("Could not open USB device\n");
-		}
-		else {
-			if(th)
-				th->signalConnected();
-			//qDebug() << "Device connected";
-		}
+		libusb_ref_device(dev);
+		QMetaObject::invokeMethod(th, [th, dev]() {th->deviceArrived(dev);}, Qt::QueuedConnection);
 	} else if (LIBUSB_HOTPLUG_EVENT_DEVICE_LEFT == event) {
-		if (deviceHandler) {
-			if(th)
-				th->signalDisconnected();
-			//qDebug() << "Device disconnected";
-			libusb_close(deviceHandler);
-			deviceHandler = nullptr;
-		}
+		libusb_ref_device(dev);
+		QMetaObject::invokeMethod(th, [th, dev]() {th->deviceLeft(dev);}, Qt::QueuedConnection);
 	} else {
 		//qDebug()<< QString("Unhandled event %d\n").arg(event);
 	}
 	return 0;
 }
 
+void usbdevice::deviceArrived(libusb_device *dev)
+{
+	// every instrument sees all the arrivals, each one keeps the first device meant for it
+	if(!deviceHandler.loadAcquire() && openHotplugged(dev))
+		signalConnected();
+	libusb_unref_device(dev);
+}
+
+void usbdevice::deviceLeft(libusb_device *dev)
+{
+	libusb_device_handle *handle = takeHandle();
+	bool ours = handle && (libusb_get_device(handle) == dev);
+	if(handle)
+		giveHandle();
+	if (ours) {
+		signalDisconnected();
+		//qDebug() << "Device disconnected";
+		closeHandle();
+	}
+	libusb_unref_device(dev);
+}
+
+bool usbdevice::openHotplugged(libusb_device *dev)
+{
+	libusb_device_handle *handle;
+	if(libusb_open(dev, &handle) != LIBUSB_SUCCESS)
+		return false;
+	if(!serial.isEmpty()) {
+		libusb_device_descriptor desc;
+		unsigned char serialStr[256];
+		if((libusb_get_device_descriptor(dev, &desc) < 0) || (libusb_get_string_descriptor_ascii(handle, desc.iSerialNumber, serialStr, sizeof(serialStr)) < 0) ||
+				(QString::fromLatin1((char*)serialStr) != serial)) {
+			libusb_close(handle);
+			return false;
+		}
+	}
+	// the device can be claimed by another instrument already
+	if(libusb_claim_interface(handle, 0) < 0) { //claim interface 0 (the first) of device (mine had jsut 1)
+		cout<<"Cannot Claim Interface"<<endl;
+		libusb_close(handle);
+		return false;
+	}
+	cout<<"Claimed Interface"<<endl;
+	setHandle(handle, nullptr);
+	return true;
+}
+
+libusb_device_handle *usbdevice::takeHandle()
+{
+	QMutexLocker locker(&transferMutex);
+	libusb_device_handle *handle = deviceHandler.loadAcquire();
+	if(handle)
+		++handleUsers;
+	return handle;
+}
+
+void usbdevice::giveHandle()
+{
+	QMutexLocker locker(&transferMutex);
+	--handleUsers;
+	transferDone.wakeAll();
+}
+
+void usbdevice::setHandle(libusb_device_handle *handle, libusb_context *context)
+{
+	// the transfers of the previous device are freed before the new one is used
+	stopTransfers();
+	QMutexLocker locker(&transferMutex);
+	handlerContext = context;
+	deviceHandler.storeRelease(handle);
+}
+
+void usbdevice::closeHandle()
+{
+	// nothing new is submitted on it from now on
+	transferMutex.lock();
+	libusb_device_handle *handle = deviceHandler.fetchAndStoreOrdered(nullptr);
+	transferMutex.unlock();
+	stopTransfers();
+	QMutexLocker locker(&transferMutex);
+	while(handleUsers > 0)
+		transferDone.wait(&transferMutex);
+	locker.unlock();
+	if(handle)
+		libusb_close(handle);
+}
+
 void usbdevice::signalConnected()
 {
 	emit connected();
@@ -338,3 +772,13 @@ void hotplugWorker::quit()
 	 run = false;
 	 //qDebug() << "QUIT";
 }
+
+void transferWorker::run()
+{
+	timeval t;
+	t.tv_sec = 0;
+	t.tv_usec = 100000;
+	while (!isInterruptionRequested()) {
+		libusb_handle_events_timeout_completed(context, &t, NULL);
+	}
+}
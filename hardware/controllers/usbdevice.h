@@ -31,9 +31,26 @@
 #include <libusb-1.0/libusb.h>
 #include <QThread>
 #include <QDebug>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QElapsedTimer>
+#include <QAtomicInt>
+#include <QAtomicPointer>
+#include <functional>
+#include "slimemulator.h"
 
 #define G8_VID 0x0547
 #define G8_PID 0x1015
+// default number of transfers kept in flight by the asynchronous transfers
+#define USB_WRITES_IN_FLIGHT 4
+#define USB_READS_IN_FLIGHT 2
+// used when the OUT endpoint descriptor can't be read
+#define USB_DEFAULT_PACKET_SIZE 64
+// reads of the wrong size tried before giving up, as the blocking version did
+#define USB_READ_RETRIES 10
+// default deadlines of the transfers, a read and its retries share the same deadline
+#define USB_WRITE_TIMEOUT_MS 1000
+#define USB_READ_TIMEOUT_MS 1000
 
 using namespace std;
 
@@ -51,6 +68,18 @@ signals:
 	void disconnected();
 };
 
+// completes the asynchronous transfers of the open device
+class transferWorker : public QThread
+{
+	Q_OBJECT
+public:
+	explicit transferWorker(QObject *parent = nullptr) : QThread(parent), context(nullptr) {}
+	void setContext(libusb_context *value) {context = value;}
+protected:
+	void run();
+private:
+	libusb_context *context;
+};
 
 class usbdevice : public QObject
 {
@@ -61,30 +90,137 @@ public:
 		QString serial;
 		int deviceNumber;
 	} usbDevice_t;
+	typedef struct {
+		quint32 timeouts; // transfers that missed their deadline
+		quint32 shortReads; // replies of the wrong size, read again
+	} transferCounters;
 	explicit usbdevice(QObject *parent = 0);
 	bool init(int debugLevel);
 	bool openDevice(int deviceNumber);
+	// uses an in-process emulation of the SLIM firmware instead of a USB device
+	bool openEmulatedDevice();
+	slimEmulator *getEmulatedDevice() const {return emulated;}
 	void closeDevice();
 	bool isHotPlugCapable();
 	QList<usbDevice_t> getDevices();
 	~usbdevice();
 	int enableCallBack(bool enable);
-	static libusb_device_handle *deviceHandler;
-	bool isConnected() {return usbdevice::deviceHandler != NULL;}
+	// only the device with this serial number is opened on hotplug, any free one if empty
+	void setSerial(QString value) {serial = value;}
+	bool isConnected() const {return (deviceHandler.loadAcquire() != nullptr) || emulated;}
 	bool sendArray(QByteArray data);
 	bool sendArray(QByteArray data, unsigned char *receivedData, int expectedSize);
+	// zero copy versions, data is handed as is to libusb
+	bool sendArray(const char *data, int size);
+	bool sendArray(const char *data, int size, unsigned char *receivedData, int expectedSize);
+	// asynchronous versions, the transfers are submitted and completed on the transfer thread
+	// so the next ones can be queued while the previous are still on the bus.
+	// Consecutive writes are combined into one bulk packet, up to the endpoint max packet size,
+	// they are only sent when the packet is full or by waitForWrites() and flush().
+	// called with the reply of a queued request, from the transfer thread
+	typedef std::function<void(quint64 tag, const unsigned char *data, int size)> readCallback;
+	void setReadCallback(readCallback callback);
+	// takes effect the next time the transfers are started
+	void setTransfersInFlight(int writes, int reads);
+	// blocks only while all the write transfers are in flight
+	bool queueArray(const char *data, int size);
+	// sends the writes combined so far with data and queues the read of the expectedSize reply,
+	// which is handed to the read callback with tag
+	bool queueArray(const char *data, int size, int expectedSize, quint64 tag);
+	// sends the combined writes and waits until all the queued writes were sent
+	bool waitForWrites();
+	// waits until all the queued transfers are completed
+	bool flush();
+	// cancels the transfers in flight and stops the transfer thread
+	void stopTransfers();
+	// deadlines of the transfers in ms, 0 waits forever.
+	// A transfer that misses its deadline fails without closing the device, the device can be used again
+	void setTimeouts(unsigned int write_ms, unsigned int read_ms);
+	transferCounters getCounters() const;
 protected:
 
 private:
 	libusb_device_handle *dev_handle; //a device handle
 	libusb_device **devs; //pointer to pointer of device, used to retrieve a list of devices
+	// set and cleared with transferMutex held, the transfers are submitted under the same mutex
+	QAtomicPointer<libusb_device_handle> deviceHandler;
+	// blocking transfers using deviceHandler without the mutex, it is not closed before they end
+	int handleUsers;
+	// the following take transferMutex, takeHandle() returns null without a device
+	libusb_device_handle *takeHandle();
+	void giveHandle();
+	// the previous device must be closed
+	void setHandle(libusb_device_handle *handle, libusb_context *context);
+	// stops the transfers and closes the device once nothing uses it anymore
+	void closeHandle();
 	libusb_context *ctx = NULL; //a libusb session
 	void printdev(libusb_device *dev);
 	static int LIBUSB_CALL hotplug_callback(libusb_context *ctx, libusb_device *dev, libusb_hotplug_event event, void *user_data);
+	// the hotplug events, handled on the thread of this object
+	void deviceArrived(libusb_device *dev);
+	void deviceLeft(libusb_device *dev);
 	QThread worker;
 	hotplugWorker *w = NULL;
 	void signalConnected();
 	void signalDisconnected();
+	typedef struct {
+		usbdevice *owner;
+		libusb_transfer *transfer;
+		QByteArray buffer;
+		quint64 tag;
+		int expectedSize;
+		int retries;
+		QElapsedTimer submitted; // reads, start of the deadline shared by the retries
+	} transferSlot;
+	// context of deviceHandler, its events are handled by transferThread
+	libusb_context *handlerContext;
+	QString serial;
+	libusb_hotplug_callback_handle hotplugHandle;
+	bool callbackEnabled;
+	bool hotplugChecked;
+	// opens dev if it has the wanted serial number, false if it is not the wanted one or is in use
+	bool openHotplugged(libusb_device *dev);
+	transferWorker transferThread;
+	QMutex transferMutex;
+	QWaitCondition transferDone;
+	QList<transferSlot *> transferSlots;
+	QList<transferSlot *> freeWrites;
+	QList<transferSlot *> freeReads;
+	int maxWrites;
+	int maxReads;
+	bool transfersStarted;
+	// stopTransfers() is waiting for the transfers in flight, no new ones are submitted
+	bool transfersStopping;
+	// writes waiting to be combined into one packet
+	QByteArray pendingWrite;
+	int maxPacketSize;
+	bool transferError;
+	// the error was a missed deadline, the device is still there
+	bool transferTimedOut;
+	unsigned int writeTimeout_ms;
+	unsigned int readTimeout_ms;
+	QAtomicInt timeouts;
+	QAtomicInt shortReads;
+	// time left in ms before the deadline of a transfer started at started, false if it passed.
+	// remaining is 0 (forever) when there is no deadline
+	static bool remainingTime(const QElapsedTimer &started, unsigned int timeout_ms, unsigned int *remaining);
+	readCallback onRead;
+	// when set every transfer goes to it instead of libusb
+	slimEmulator *emulated;
+	// reads waiting for their emulated reply, in request order
+	QList<transferSlot *> emulatedReads;
+	// the following must be called with transferMutex held
+	bool startTransfers();
+	transferSlot *takeTransfer(QList<transferSlot *> &pool);
+	bool combineWrite(const char *data, int size);
+	bool submitPending();
+	bool submitTransfer(transferSlot *slot, unsigned char endpoint, int size);
+	bool waitForIdle(bool readsToo);
+	// hands the emulated replies to the reads waiting for them
+	void deliverEmulatedReads();
+	// closes the device after a failed transfer, as the blocking version does
+	void transferFailed();
+	static void LIBUSB_CALL transferCallback(libusb_transfer *transfer);
 signals:
 	void disconnected();
 	void connected();
@@ -28,7 +28,10 @@
 #include "lmx2326.h"
 #include "ad9850.h"
 #include "genericadc.h"
+#include "scanplan.h"
+#include "frequencykernel.h"
 #include "../hardware/controllers/interface.h"
+#include <algorithm>
 
 deviceParser::~deviceParser()
 {
@@ -49,7 +52,7 @@ deviceParser::deviceParser(msa::MSAdevice dev, hardwareDevice *parent) : QObject
 		hwdev = adc->getHardwareType();
 }
 
-double deviceParser::parsePLLRCounter(msa::scanConfig config)
+double deviceParser::parsePLLRCounter(const msa::scanConfig &config)
 {
 	double ret = -1;
 	switch (msadev) {
@@ -88,110 +91,34 @@ double deviceParser::parsePLLRCounter(msa::scanConfig config)
 
 #define myDebug() qDebug() << fixed << qSetRealNumberPrecision(12)
 
-double deviceParser::parsePLLNCounter(msa::scanConfig configuration, msa::scanStep &step, quint32 stepNumber, bool &error, bool &fatalError)
+double deviceParser::parsePLLNCounter(const msa::scanConfig &configuration, const scanPlan *plan, quint32 stepNumber, bool &error, bool &fatalError)
 {
 	error = false;
 	fatalError = false;
 	double ncounter = 0;
 	double ncount = 0;
+	double LO1 = 0;
 	genericPLL *lmx = nullptr;
 	switch (msadev) {
 	case msa::PLL1:
-		if (stepNumber == quint32(HW_INIT_STEP))
-			return -1;
-		switch (hwdev) {
-		case hardwareDevice::LMX2326:
-			lmx = dynamic_cast<genericPLL *>(msa::getInstance().currentHardwareDevices.value(msadev));
-			step.LO1 = configuration.baseFrequency + step.translatedFrequency + configuration.LO2 - configuration.pathCalibration.centerFreq_MHZ;
-			if (step.LO1 > 2200) {
-				msa::getInstance().currentInterface->errorOcurred(msadev, QString("LO1 will be above 2200MHz for step %1").arg(stepNumber), true, false);
-				error = true;
-				fatalError = true;
-			} else if (step.LO1 < 950) {
-				msa::getInstance().currentInterface->errorOcurred(msadev, QString("LO1 will be below 950MHz for step %1").arg(stepNumber), true, false);
-				error = true;
-				fatalError = true;
-			}
-			ncount = step.LO1/(configuration.appxdds1/ lmx->getRCounter()); // approximates the Ncounter for PLL
-			ncounter = int(round(ncount)); // approximates the ncounter for PLL
-			lmx->setPFD(step.LO1/ncounter, stepNumber);// approx phase freq of PLL
-			if (msa::getInstance().currentInterface->getDebugLevel() > 2) {
-				myDebug() << "LO1 step:"<< stepNumber << step.LO1 <<"="<< configuration.baseFrequency <<"+"<< step.translatedFrequency <<"+"<< configuration.LO2 <<"-"
-						  << configuration.pathCalibration.centerFreq_MHZ;
-				myDebug()<< "PLL1 "<< "step:"<<stepNumber << "PFD:"<<step.LO1/ncounter;
-			}
-			break;
-		default:
-			break;
-		}
-		break;
+	case msa::PLL3:
+		// the scan steps of PLL1 and PLL3 are computed by parsePLLRange()
+		return -1;
 	case msa::PLL2:
 		switch (hwdev) {
 		case hardwareDevice::LMX2326:
 			if (stepNumber == quint32(HW_INIT_STEP)) {
-				lmx = dynamic_cast<genericPLL *>(msa::getInstance().currentHardwareDevices.value(msadev));
+				lmx = dynamic_cast<genericPLL *>(device->getInstrument().currentHardwareDevices.value(msadev));
 				ncount = configuration.LO2/(configuration.masterOscilatorFrequency / lmx->getRCounter()); // approximates the Ncounter for PLL
 				ncounter = int(round(ncount)); // approximates the ncounter for PLL
 			lmx->setPFD(configuration.LO2/ncounter, stepNumber);// approx phase freq of PLL
 			}
 			else if(configuration.cavityTestRunning){
-				lmx = dynamic_cast<genericPLL *>(msa::getInstance().currentHardwareDevices.value(msadev));
-				ncount = (step.LO1 + configuration.pathCalibration.centerFreq_MHZ)/(configuration.masterOscilatorFrequency/ lmx->getRCounter()); // approximates the Ncounter for PLL
-				ncounter = int(round(ncount)); // approximates the ncounter for PLL
-				lmx->setPFD(step.LO1 + configuration.pathCalibration.centerFreq_MHZ, stepNumber);// approx phase freq of PLL
-			}
-			break;
-		default:
-			break;
-		}
-		break;
-	case msa::PLL3:
-		step.LO3 = 0;
-		if (stepNumber == quint32(HW_INIT_STEP))
-			return -1;
-		switch (hwdev) {
-		case hardwareDevice::LMX2326:
-			lmx = dynamic_cast<genericPLL *>(msa::getInstance().currentHardwareDevices.value(msadev));
-			if (configuration.scanType == ComProtocol::SA_TG) {
-				if (!configuration.gui.TGreversed) {
-					if (step.band == 3)
-						step.LO3 = step.realFrequency + configuration.gui.TGoffset - configuration.LO2;
-					else
-						step.LO3 = configuration.LO2 + step.translatedFrequency + configuration.gui.TGoffset;
-				} else {
-					double reversedFrequency;
-					quint32 reversedIndex = uint(msa::getInstance().currentScan.steps->size()) - stepNumber - 1;
-					if (step.band == 1)
-						reversedFrequency = msa::getInstance().currentScan.steps->value(reversedIndex).realFrequency;
-					else
-						reversedFrequency = msa::getInstance().currentScan.steps->value(reversedIndex).translatedFrequency;
-					if (step.band == 3)
-						step.LO3 = msa::getInstance().currentScan.steps->value(reversedIndex).realFrequency + configuration.gui.TGoffset - configuration.LO2;
-					else
-						step.LO3 = configuration.LO2 + reversedFrequency + configuration.gui.TGoffset;
-				}
-				step.LO3 = configuration.LO2 - configuration.pathCalibration.centerFreq_MHZ - configuration.gui.TGoffset;
-			} else if (configuration.scanType == ComProtocol::SA_SG) {
-				if (configuration.gui.SGout <= configuration.LO2)
-					step.LO3 = configuration.gui.SGout + configuration.LO2;
-				else if (configuration.gui.SGout > (2*configuration.LO2))
-					step.LO3 = configuration.gui.SGout - configuration.LO2;
-				else
-					step.LO3 = configuration.gui.SGout;
-			}
-			if (lmx) {
-				ncount = step.LO3/(configuration.appxdds3/ lmx->getRCounter()); // approximates the Ncounter for PLL
+				lmx = dynamic_cast<genericPLL *>(device->getInstrument().currentHardwareDevices.value(msadev));
+				LO1 = plan->value(stepNumber).LO1;
+				ncount = (LO1 + configuration.pathCalibration.centerFreq_MHZ)/(configuration.masterOscilatorFrequency/ lmx->getRCounter()); // approximates the Ncounter for PLL
 				ncounter = int(round(ncount)); // approximates the ncounter for PLL
-				lmx->setPFD(step.LO3/ncounter, stepNumber);// approx phase freq of PLL
-			}
-			if (step.LO3 > 2200) {
-				msa::getInstance().currentInterface->errorOcurred(msadev, QString("LO3 will be above 2200MHz for step %1").arg(stepNumber), true, false);
-				error = true;
-				fatalError = true;
-			} else if (step.LO3 < 950) {
-				msa::getInstance().currentInterface->errorOcurred(msadev, QString("LO3 will be below 950MHz for step %1").arg(stepNumber), true, false);
-				error = true;
-				fatalError = true;
+				lmx->setPFD(LO1 + configuration.pathCalibration.centerFreq_MHZ, stepNumber);// approx phase freq of PLL
 			}
 			break;
 		default:
@@ -204,7 +131,48 @@ double deviceParser::parsePLLNCounter(msa::scanConfig configuration, msa::scanSt
 	return ncounter;
 }
 
-bool deviceParser::getPLLinverted(msa::scanConfig config)
+bool deviceParser::parsePLLRange(const msa::scanConfig &configuration, const scanPlan *plan, double rcounter, quint32 first, quint32 last, double *ncounter, double *pfd, bool &fatalError)
+{
+	bool error = false;
+	fatalError = false;
+	if (hwdev != hardwareDevice::LMX2326)
+		return false;
+	quint32 count = last - first;
+	// the LOs were computed by msa::initScan() when the plan was built
+	const double *LO;
+	double approximatePFD;
+	switch (msadev) {
+	case msa::PLL1:
+		LO = plan->LO1.constData() + first;
+		approximatePFD = configuration.appxdds1 / rcounter;
+		break;
+	case msa::PLL3:
+		LO = plan->LO3.constData() + first;
+		approximatePFD = configuration.appxdds3 / rcounter;
+		break;
+	default:
+		// PLL2 does not change during the scan
+		return false;
+	}
+	frequencyKernel::pllCounters(LO, approximatePFD, ncounter, pfd, count);
+	bool debug = (msadev == msa::PLL1) && (device->getInstrument().currentInterface->getDebugLevel() > 2);
+	for (quint32 i = 0; i < count; ++i) {
+		quint32 stepNumber = first + i;
+		// reported to the user by planValidator before the compilation
+		if ((LO[i] > 2200) || (LO[i] < 950)) {
+			error = true;
+			fatalError = true;
+		}
+		if (debug) {
+			myDebug() << "LO1 step:"<< stepNumber << LO[i] <<"="<< configuration.baseFrequency <<"+"<< plan->translatedFrequency.at(int(stepNumber)) <<"+"<< configuration.LO2 <<"-"
+					  << configuration.pathCalibration.centerFreq_MHZ;
+			myDebug()<< "PLL1 "<< "step:"<<stepNumber << "PFD:"<<pfd[i];
+		}
+	}
+	return error;
+}
+
+bool deviceParser::getPLLinverted(const msa::scanConfig &config)
 {
 	switch (msadev) {
 	case msa::PLL1:
@@ -218,76 +186,58 @@ bool deviceParser::getPLLinverted(msa::scanConfig config)
 	}
 }
 
-quint32 deviceParser::parseDDSOutput(msa::scanConfig configuration, quint32 stepNumber, bool &error, bool &fatalError)
+bool deviceParser::parseDDSRange(const msa::scanConfig &configuration, quint32 first, quint32 last, quint32 slot, quint32 *base, double *ddsout, bool *valid, bool &fatalError)
 {
-	error = false;
+	bool error = false;
 	fatalError = false;
-	double ddsoutput = 0;
-	double fullbase = 0;
-	double base = 0;
+	quint32 count = last - first;
+	std::fill(valid, valid + count, false);
+	if (hwdev != hardwareDevice::AD9850)
+		return false;
+	const msa::forceDDS *forced;
+	genericPLL *pll;
+	double appxdds;
+	double filterBandwidth;
 	switch (msadev) {
 	case msa::DDS1:
-		switch (hwdev) {
-		case hardwareDevice::AD9850:
-			if (configuration.forcedDDS1.isForced) {
-				fullbase = (configuration.forcedDDS1.outputFreq * pow(2, 32) / configuration.forcedDDS1.oscFreq);
-				base = round(fullbase);
-				ddsoutput = base*configuration.forcedDDS1.oscFreq/pow(2, 32);
-				(dynamic_cast<genericDDS *>(msa::getInstance().currentHardwareDevices.value(msa::DDS1)))->setDDSOutput(ddsoutput, stepNumber);
-				if(stepNumber == 1)
-					myDebug() << "Base for DDS1" << base;
-			} else {
-				ddsoutput = ((genericPLL *)msa::getInstance().currentHardwareDevices.value(msa::PLL1))->getPFD(stepNumber)
-							* ((genericPLL *)msa::getInstance().currentHardwareDevices.value(msa::PLL1))->getRCounter();
-				fullbase = (ddsoutput*pow(2, 32)/configuration.masterOscilatorFrequency);
-				base = round(fullbase);
-				ddsoutput = base*msa::getInstance().currentScan.configuration.masterOscilatorFrequency/pow(2, 32);
-				(dynamic_cast<genericDDS *>(msa::getInstance().currentHardwareDevices.value(msa::DDS1)))->setDDSOutput(ddsoutput, stepNumber);
-				////qDebug() << qSetRealNumberPrecision( 10 ) << "target freq"<< scan.steps[step].frequency << "ddsoutput" << ddsoutput << "VCO" <<getVcoFrequency(ddsoutput) << "DIFF" <<10.7 - (1024 - getVcoFrequency(ddsoutput));
-				if (qAbs(ddsoutput - configuration.appxdds1) > (configuration.dds1Filterbandwidth / 2)) {
-					error = true;
-					fatalError = true;
-					msa::getInstance().currentInterface->errorOcurred(msadev, QString(
-																		  "DDS1 output would be outside its output filter bandwidth for step %1").arg(stepNumber), true, false);
-				}
-				if (msa::getInstance().currentInterface->getDebugLevel() > 2)
-					myDebug() << "DD1 step" << stepNumber << " ddsoutput=" << ddsoutput << " base:" << base << " fullbase:"<<fullbase;
-			}
-			break;
-		default:
-			break;
-		}
+		forced = &configuration.forcedDDS1;
+		pll = qobject_cast<genericPLL *>(device->getInstrument().currentHardwareDevices.value(msa::PLL1));
+		appxdds = configuration.appxdds1;
+		filterBandwidth = configuration.dds1Filterbandwidth;
 		break;
 	case msa::DDS3:
-		switch (hwdev) {
-		case hardwareDevice::AD9850:
-			if (configuration.forcedDDS3.isForced) {
-				fullbase = (configuration.forcedDDS3.outputFreq * pow(2, 32) / configuration.forcedDDS3.oscFreq);
-				base = round(fullbase);
-				ddsoutput = base*configuration.forcedDDS3.oscFreq/pow(2, 32);     // 117c19
-				((genericDDS *)msa::getInstance().currentHardwareDevices.value(msa::DDS3))->setDDSOutput(ddsoutput, stepNumber);
-			} else {
-				ddsoutput = ((genericPLL *)msa::getInstance().currentHardwareDevices.value(msa::PLL3))->getPFD(stepNumber)
-							* ((genericPLL *)msa::getInstance().currentHardwareDevices.value(msa::PLL3))->getRCounter();
-				fullbase = (ddsoutput*pow(2, 32)/configuration.masterOscilatorFrequency); // decimal number, including fraction
-				base = round(fullbase);
-				ddsoutput = base*msa::getInstance().currentScan.configuration.masterOscilatorFrequency/pow(2, 32); // 117c19
-				((genericDDS *)msa::getInstance().currentHardwareDevices.value(msa::DDS3))->setDDSOutput(ddsoutput, stepNumber);
-				////qDebug() << qSetRealNumberPrecision( 10 ) << "target freq"<< scan.steps[step].frequency << "ddsoutput" << ddsoutput << "VCO" <<getVcoFrequency(ddsoutput) << "DIFF" <<10.7 - (1024 - getVcoFrequency(ddsoutput));
-				if ((ddsoutput- configuration.appxdds3) > (configuration.dds3Filterbandwidth / 2)) {
-					error = true;
-					fatalError = true;
-					msa::getInstance().currentInterface->errorOcurred(msadev, QString(
-																		  "DDS3 output would be outside its output filter bandwidth for step %1").arg(stepNumber), true, false);
-				}
-			}
-			break;
-		default:
-			break;
-		}
+		forced = &configuration.forcedDDS3;
+		pll = qobject_cast<genericPLL *>(device->getInstrument().currentHardwareDevices.value(msa::PLL3));
+		appxdds = configuration.appxdds3;
+		filterBandwidth = configuration.dds3Filterbandwidth;
 		break;
 	default:
-		break;
+		return false;
+	}
+	if (forced->isForced) {
+		frequencyKernel::ddsForced(forced->outputFreq, forced->oscFreq, base, ddsout, count);
+		std::fill(valid, valid + count, true);
+		if ((msadev == msa::DDS1) && (first <= 1) && (last > 1))
+			myDebug() << "Base for DDS1" << base[1 - first];
+		return false;
+	}
+	if (!pll) {
+		device->getInstrument().currentInterface->errorOcurred(msadev, "The PLL driving this DDS is not configured", true, false);
+		fatalError = true;
+		return true;
+	}
+	// the DDS is the reference of its PLL, so it must output pfd * rcounter
+	frequencyKernel::ddsTuning(pll->getPFDData() + slot, pll->getRCounter(), configuration.masterOscilatorFrequency, base, ddsout, count);
+	bool debug = (msadev == msa::DDS1) && (device->getInstrument().currentInterface->getDebugLevel() > 2);
+	for (quint32 i = 0; i < count; ++i) {
+		quint32 stepNumber = first + i;
+		valid[i] = qAbs(ddsout[i] - appxdds) <= (filterBandwidth / 2);
+		if (!valid[i]) {
+			error = true;
+			fatalError = true;
+		}
+		if (debug)
+			myDebug() << "DD1 step" << stepNumber << " ddsoutput=" << ddsout[i] << " base:" << base[i];
 	}
-	return static_cast<quint32>(base);
+	return error;
 }
@@ -31,15 +31,22 @@
 #include <QHash>
 #include "msa.h"
 
+class scanPlan;
+
 class deviceParser:public QObject
 {
 	Q_OBJECT
 public:
 	deviceParser(msa::MSAdevice dev, hardwareDevice *parent);
-	double parsePLLRCounter(msa::scanConfig config);
-	double parsePLLNCounter(msa::scanConfig configuration, msa::scanStep &step, quint32 stepNumber, bool &error, bool &fatalError);
-	bool getPLLinverted(msa::scanConfig config);
-	quint32 parseDDSOutput(msa::scanConfig configuration, quint32 stepNumber, bool &error, bool &fatalError);
+	double parsePLLRCounter(const msa::scanConfig &config);
+	// N counter of the steps that are not part of the scan arrays (PLL2 and the init steps)
+	double parsePLLNCounter(const msa::scanConfig &configuration, const scanPlan *plan, quint32 stepNumber, bool &error, bool &fatalError);
+	// fills the plan LO, the N counter and the PFD of steps [first, last[, returns true on error
+	bool parsePLLRange(const msa::scanConfig &configuration, const scanPlan *plan, double rcounter, quint32 first, quint32 last, double *ncounter, double *pfd, bool &fatalError);
+	bool getPLLinverted(const msa::scanConfig &config);
+	// fills the tuning word and output frequency of steps [first, last[, the PLL PFDs must already be computed at slot.
+	// valid is cleared for the steps whose output falls outside the DDS filter, returns true if any is
+	bool parseDDSRange(const msa::scanConfig &configuration, quint32 first, quint32 last, quint32 slot, quint32 *base, double *ddsout, bool *valid, bool &fatalError);
 	hardwareDevice::HWdevice getDeviceType() {return hwdev;}
 	msa::MSAdevice getDevice() {return msadev;}
 	~deviceParser();
@@ -0,0 +1,110 @@
+/**
+ ******************************************************************************
+ *
+ * @file       main.cpp
+ * @author     Jose Barros (AKA PT_Dreamer) josemanuelbarros@gmail.com 2019
+ * @brief      frequencykernel.cpp file
+ * @see        The GNU Public License (GPL) Version 3
+ * @defgroup   frequencyKernel
+ * @{
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+#include "frequencykernel.h"
+#include "scanplan.h"
+#include <cmath>
+
+// 2^32, the AD9850 phase accumulator size
+#define DDS_ACCUMULATOR 4294967296.0
+
+void frequencyKernel::LO1(const double *translatedFrequency, double baseFrequency, double LO2, double IFcenter, double *LO, quint32 count)
+{
+	for(quint32 i = 0; i < count; ++i)
+		LO[i] = baseFrequency + translatedFrequency[i] + LO2 - IFcenter;
+}
+
+double frequencyKernel::LO3(const msa::scanConfig &configuration)
+{
+	switch (configuration.scanType) {
+	case ComProtocol::SA_TG:
+		// the tracking generator runs at a fixed LO3, the band dependent formulas were never used
+		return configuration.LO2 - configuration.pathCalibration.centerFreq_MHZ - configuration.gui.TGoffset;
+	case ComProtocol::SA_SG:
+		if (configuration.gui.SGout <= configuration.LO2)
+			return configuration.gui.SGout + configuration.LO2;
+		else if (configuration.gui.SGout > (2*configuration.LO2))
+			return configuration.gui.SGout - configuration.LO2;
+		return configuration.gui.SGout;
+	default:
+		return 0;
+	}
+}
+
+void frequencyKernel::fill(double value, double *dest, quint32 count)
+{
+	for(quint32 i = 0; i < count; ++i)
+		dest[i] = value;
+}
+
+void frequencyKernel::pllCounters(const double *LO, double approximatePFD, double *ncounter, double *pfd, quint32 count)
+{
+	for(quint32 i = 0; i < count; ++i) {
+		double n = std::round(LO[i]/approximatePFD);
+		ncounter[i] = n;
+		pfd[i] = LO[i]/n;
+	}
+}
+
+void frequencyKernel::ddsTuning(const double *pfd, double rcounter, double oscillator, quint32 *base, double *ddsout, quint32 count)
+{
+	for(quint32 i = 0; i < count; ++i) {
+		double b = std::round(pfd[i] * rcounter * DDS_ACCUMULATOR / oscillator);
+		base[i] = static_cast<quint32>(b);
+		ddsout[i] = b * oscillator / DDS_ACCUMULATOR;
+	}
+}
+
+void frequencyKernel::ddsForced(double output, double oscillator, quint32 *base, double *ddsout, quint32 count)
+{
+	double b = std::round(output * DDS_ACCUMULATOR / oscillator);
+	for(quint32 i = 0; i < count; ++i) {
+		base[i] = static_cast<quint32>(b);
+		ddsout[i] = b * oscillator / DDS_ACCUMULATOR;
+	}
+}
+
+void frequencyKernel::settleTimes(const double *LO1, const int *band, quint32 count, bool inverted, const msa::settlingModel &model, quint32 *settle_us)
+{
+	if(!model.adaptive) {
+		for(quint32 i = 0; i < count; ++i)
+			settle_us[i] = SETTLE_FULL;
+		return;
+	}
+	for(quint32 i = 0; i < count; ++i) {
+		bool first = inverted ? (i == count - 1) : (i == 0);
+		if(first) {
+			settle_us[i] = SETTLE_FULL;
+			continue;
+		}
+		quint32 previous = inverted ? i + 1 : i - 1;
+		if(band[i] != band[previous]) {
+			settle_us[i] = SETTLE_FULL;
+			continue;
+		}
+		double wait = model.minimum_us + std::abs(LO1[i] - LO1[previous]) * model.PLL_us_per_MHz;
+		settle_us[i] = (wait >= double(SETTLE_FULL)) ? SETTLE_FULL : static_cast<quint32>(std::ceil(wait));
+	}
+}
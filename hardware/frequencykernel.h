@@ -0,0 +1,58 @@
+/**
+ ******************************************************************************
+ *
+ * @file       main.cpp
+ * @author     Jose Barros (AKA PT_Dreamer) josemanuelbarros@gmail.com 2019
+ * @brief      frequencykernel.h file
+ * @see        The GNU Public License (GPL) Version 3
+ * @defgroup   frequencyKernel
+ * @{
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef FREQUENCYKERNEL_H
+#define FREQUENCYKERNEL_H
+
+#include <QtGlobal>
+#include "msa.h"
+
+// Batch frequency plan math of a step range.
+// All functions work on plain arrays already offset to the first step of the range,
+// there are no lookups or branches inside the loops so the compiler can vectorize them.
+// Every formula keeps the operation order of the original per step code so the
+// results are bit identical.
+class frequencyKernel
+{
+public:
+	// LO1 = baseFrequency + translatedFrequency + LO2 - IF center frequency
+	static void LO1(const double *translatedFrequency, double baseFrequency, double LO2, double IFcenter, double *LO, quint32 count);
+	// LO3 of the scan, it does not depend on the step so the scan type is resolved once per range
+	static double LO3(const msa::scanConfig &configuration);
+	static void fill(double value, double *dest, quint32 count);
+	// rounded N counter of a PLL for each LO and the resulting phase detector frequency,
+	// approximatePFD is the reference (appxdds) divided by the R counter
+	static void pllCounters(const double *LO, double approximatePFD, double *ncounter, double *pfd, quint32 count);
+	// AD9850 tuning word producing pfd * rcounter and the exact output frequency of that word
+	static void ddsTuning(const double *pfd, double rcounter, double oscillator, quint32 *base, double *ddsout, quint32 count);
+	// fixed output of a forced DDS
+	static void ddsForced(double output, double oscillator, quint32 *base, double *ddsout, quint32 count);
+	// settle time of each step from the LO1 jump since the previous step in the scan direction.
+	// LO3 does not change during a scan, so band changes and the first step of the sweep, which
+	// follows the wrap around or a new configuration, wait the whole delay (SETTLE_FULL)
+	static void settleTimes(const double *LO1, const int *band, quint32 count, bool inverted, const msa::settlingModel &model, quint32 *settle_us);
+};
+
+#endif // FREQUENCYKERNEL_H
@@ -36,7 +36,6 @@ public:
 	bool processNewScan(){return false;}
 	bool init();
 	void reinit(){}
-	bool checkSettings(){return true;}
 	hardwareDevice::HWdevice getHardwareType() {return adc_type;}
 	// gets the type of CLK this device needs, dedicated or system wide
 	clockType getClk_type() const;
@@ -25,14 +25,18 @@
  */
 #include "hardwaredevice.h"
 #include "deviceparser.h"
+#include "scanplan.h"
+#include "controllers/interface.h"
 #include <QDebug>
 
-void hardwareDevice::setNewScan(msa::scanStruct scan) {
-	msa::getInstance().currentScan = scan;
+void hardwareDevice::setNewScan(const msa::scanStruct &scan) {
+	instrument->currentScan = scan;
 }
 
 hardwareDevice::hardwareDevice(QObject *parent):QObject(parent), registerSize(0)
 {
+	interface *owner = qobject_cast<interface *>(parent);
+	instrument = owner ? &owner->getInstrument() : &msa::getInstance();
 }
 
 const QHash<int, hardwareDevice::devicePin*>  hardwareDevice::getDevicePins()
@@ -50,69 +54,40 @@ hardwareDevice::HWdevice hardwareDevice::getHardwareType()
 	return parser->getDeviceType();
 }
 
-bool hardwareDevice::setFieldRegister(int field, quint32 value)
+bool hardwareDevice::processNewScan()
 {
-	field_struct st = fieldlist.value(field);
-	value = value << st.offset;
-	*st.reg = *st.reg & ~st.mask;
-	*st.reg|= value;
-	return checkSettings();
+	// the scan started last, nothing to compile before the first one
+	msa::scanSnapshot scan = instrument->getSnapshot();
+	if(!scan)
+		return true;
+	quint32 steps = scan->steps->size();
+	prepareScan(steps, scan);
+	return processStepRange(0, steps, 0);
 }
 
-int hardwareDevice::getFieldRegister(int field)
+void hardwareDevice::prepareScan(quint32 slots, const msa::scanSnapshot &scan)
 {
-	quint64 *r = fieldsPerRegister.key(field);
-	quint64 rval = *r;
-	field_struct st = fieldlist.value(field);
-	rval &= st.mask;
-	return rval >> st.offset;
+	snapshot = scan;
+	stepRegisters.fill(0, int(slots));
 }
 
-QString hardwareDevice::convertToStr(quint64 *reg)
+bool hardwareDevice::processStepRange(quint32 first, quint32 last, quint32 slot)
 {
-	quint64 value = *reg;
-	QString ret = "000000000000000000000";
-	quint64 temp = 0;
-	int i = 0;
-	for(i = 0; i < 20; ++i) {
-		temp = (quint64)(value / 2);
-		quint64 temp2 = value - 2*temp;
-		ret.replace(i,1,QString::number(temp2));
-		value = temp;
-	};
-
-	ret.replace(i, 1, QString::number(temp));
-	QList<int> index;
-	foreach (int t, fieldlist.keys()) {
-		field_struct st = fieldlist.value(t);
-		if(st.reg == reg) {
-			index << st.offset + st.bits;
-		}
-	}
-	std::sort(index.begin(), index.end());
-	int c = 0;
-	foreach (int i, index) {
-		if(i < 21) {
-			ret.insert(i + c, "---");
-			c+= 3;
-		}
-	}
-	return ret;
+	Q_UNUSED(first)
+	Q_UNUSED(last)
+	Q_UNUSED(slot)
+	return false;
 }
 
-void hardwareDevice::fillField(int field, QList<int> bits, quint64 *reg)
+QString hardwareDevice::convertToStr(quint64 reg, quint64 boundaries) const
 {
-	fieldsPerRegister.insert(reg, field);
-	std::sort(bits.begin(), bits.end());
-	field_struct st;
-	st.mask = 0;
-	foreach (int bit, bits) {
-		st.mask |= (1 << bit);
+	QString ret;
+	for(int bit = 0; bit < registerSize; ++bit) {
+		if(bit && ((boundaries >> bit) & 1))
+			ret.append("---");
+		ret.append(((reg >> bit) & 1) ? '1' : '0');
 	}
-	st.bits = bits.count();
-	st.offset = bits.first();
-	st.reg = reg;
-	fieldlist.insert(field, st);
+	return ret;
 }
 
 hardwareDevice::pin_data hardwareDevice::createPinData(int size) {
@@ -163,6 +138,34 @@ genericPLL::genericPLL(QObject *parent):hardwareDevice(parent)
 {
 }
 
+void genericPLL::setPFD(double value, quint32 step)
+{
+	if(step < quint32(pfd.size()))
+		pfd[int(step)] = value;
+	else
+		initPfd.insert(step, value);
+}
+
+void genericPLL::prepareScan(quint32 steps, const msa::scanSnapshot &scan)
+{
+	hardwareDevice::prepareScan(steps, scan);
+	pfd.fill(0, int(steps));
+}
+
 genericDDS::genericDDS(QObject *parent):hardwareDevice(parent)
 {
 }
+
+void genericDDS::setDDSOutput(double value, quint32 step)
+{
+	if(step < quint32(ddsout.size()))
+		ddsout[int(step)] = value;
+	else
+		initDdsout.insert(step, value);
+}
+
+void genericDDS::prepareScan(quint32 steps, const msa::scanSnapshot &scan)
+{
+	hardwareDevice::prepareScan(steps, scan);
+	ddsout.fill(0, int(steps));
+}
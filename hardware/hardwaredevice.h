@@ -27,10 +27,12 @@
 #define HARDWAREDEVICE_H
 
 #include <QList>
+#include <QVector>
 #include <QBitArray>
 #include <limits>
 #include <QObject>
 #include "msa.h"
+#include "registerfield.h"
 
 #define HW_INIT_STEP std::numeric_limits<quint32>::max()
 #define SCAN_INIT_STEP HW_INIT_STEP-1
@@ -44,6 +46,7 @@ public:
 	typedef enum {LMX2326, AD9850, AD7685, LT1865, NONE} HWdevice;
 	typedef enum {MAIN_DATA, GEN_INPUT, GEN_OUTPUT, INPUT_OUTPUT, CLK, VIRTUAL_CLK}pinType;
 	typedef enum {CLOCK_RISING_EDGE, CLOCK_FALLING_EDGE}clockType;
+	typedef enum {MSB_FIRST, LSB_FIRST}bitOrder;
 	typedef struct {
 		QBitArray *dataArray;
 		QBitArray *dataMask;
@@ -54,7 +57,14 @@ public:
 		void *hwconfig;
 		QHash<quint32, pin_data> data;//dataarray containing the serialized bit values for each scan step
 	} devicePin;
-	virtual bool processNewScan()=0;
+	// compiles the current scan, prepareScan() followed by processStepRange() over all the steps
+	virtual bool processNewScan();
+	// serial part of the scan compilation, allocates the per step storage for the given number of slots
+	// and keeps scan for all the step ranges compiled after it
+	virtual void prepareScan(quint32 slots, const msa::scanSnapshot &scan);
+	// compiles steps [first, last[ into the storage starting at slot (the step itself unless the plan is streamed),
+	// safe to call concurrently for disjoint ranges once prepareScan() was called
+	virtual bool processStepRange(quint32 first, quint32 last, quint32 slot);
 	virtual bool init()=0;
 	virtual void reinit()=0;
 	// gets the type of CLK this device needs, dedicated or system wide
@@ -64,28 +74,25 @@ public:
 	~hardwareDevice();
 	QHash<int, devicePin*> devicePins;
 	HWdevice getHardwareType();
-	static void setNewScan(msa::scanStruct scan);
+	void setNewScan(const msa::scanStruct &scan);
+	msa &getInstrument() const {return *instrument;}
 	QList<quint32> getInitIndexes(){return initIndexes;}
+	// gets the order in which the register bits are shifted out on the data pin
+	virtual bitOrder getBitOrder() const {return MSB_FIRST;}
+	int getRegisterSize() const {return registerSize;}
+	// packed register of each scan step slot, the pin data is only kept for the init steps
+	const QVector<quint64> &getStepRegisters() const {return stepRegisters;}
 protected:
-	typedef struct {
-		quint64 mask;
-		quint8 offset;
-		quint8 bits;
-		quint64 *reg;
-	} field_struct;
+	msa *instrument;
+	// configuration and plan of the scan being compiled, set by prepareScan() for all its step ranges
+	msa::scanSnapshot snapshot;
+	QVector<quint64> stepRegisters;
 	QList<quint32> initIndexes;
 	deviceParser *parser;
-	// contains a structure describing each field, where it is, how bit it is, etc...
-	QHash<int, field_struct> fieldlist;
-	// contains all fields for a given device register
-	QMultiHash<quint64 *, int> fieldsPerRegister;
-	bool setFieldRegister(int field, quint32 value);
-	int getFieldRegister(int field);
-	virtual bool checkSettings() = 0;
-
-	QString convertToStr(quint64 *reg);
-	// automagically fills fieldlist by passing the field mask and destination register
-	void fillField(int field, QList<int> bits, quint64 *reg);
+	// sets a field described by a registerField type on the given register
+	template<typename field> static void setField(quint64 &reg, quint64 value) {reg = field::set(reg, value);}
+	// prints the register LSB first, boundaries has a bit set at the first bit of each field
+	QString convertToStr(quint64 reg, quint64 boundaries) const;
 	void registerToBuffer(quint64 *reg, int pin, quint32 step);
 	int registerSize;
 	hardwareDevice::pin_data createPinData(int size);
@@ -99,11 +106,15 @@ class genericPLL: public hardwareDevice
 	Q_OBJECT
 public:
 	genericPLL(QObject *parent);
-	virtual double getPFD(quint32 step) {return pfd.value(step);}
-	void setPFD(double value, quint32 step){pfd.insert(step, value);}
+	virtual double getPFD(quint32 step) {return (step < quint32(pfd.size())) ? pfd.at(int(step)) : initPfd.value(step);}
+	void setPFD(double value, quint32 step);
+	// PFD of the scan steps, indexed by slot
+	const double *getPFDData() const {return pfd.constData();}
 	virtual int getRCounter() = 0;
+	void prepareScan(quint32 steps, const msa::scanSnapshot &scan);
 protected:
-	QHash<quint32, double> pfd;
+	QVector<double> pfd;
+	QHash<quint32, double> initPfd;
 };
 
 class genericDDS: public hardwareDevice
@@ -111,10 +122,12 @@ class genericDDS: public hardwareDevice
 	Q_OBJECT
 public:
 	genericDDS(QObject *parent);
-	double getDDSOutput(quint32 step) {return ddsout.value(step);}
-	void setDDSOutput(double value, quint32 step) {ddsout.insert(step, value);}
+	double getDDSOutput(quint32 step) {return (step < quint32(ddsout.size())) ? ddsout.at(int(step)) : initDdsout.value(step);}
+	void setDDSOutput(double value, quint32 step);
+	void prepareScan(quint32 steps, const msa::scanSnapshot &scan);
 protected:
-	QHash<quint32, double> ddsout;
+	QVector<double> ddsout;
+	QHash<quint32, double> initDdsout;
 };
 
 #endif // HARDWAREDEVICE_H
@@ -1,6 +1,7 @@
 #include "lmx2326.h"
 #include <QDebug>
 #include "../hardware/controllers/interface.h"
+#include "scanplan.h"
 
 lmx2326::lmx2326(msa::MSAdevice device, QObject *parent):genericPLL(parent)
 {
@@ -9,63 +10,8 @@ lmx2326::lmx2326(msa::MSAdevice device, QObject *parent):genericPLL(parent)
 	s.latches = 0;
 	s.ncounter = 0;
 	s.rcounter = 0;
-	QList<int> bits;
-	//bit numbering follows ADF4118 datasheet, LMX2326 is inverted
-	bits << 20;
-	fillField(R_LD, bits, &s.rcounter);
-	bits.clear();
-	bits << 19 << 18<< 17 << 16;
-	fillField(R_TESTMODES, bits, &s.rcounter);
-	bits.clear();
-	bits << 15 << 14 << 13 << 12 << 11 << 10 << 9 << 8 << 7 << 6
-		 << 5 << 4 << 3<< 2;
-	fillField(R_DIVIDER, bits, &s.rcounter);
-	bits.clear();
-	bits << 1 << 0;
-	fillField(R_CC, bits, &s.rcounter);
-	fillField(L_CC, bits, &s.latches);
-	fillField(N_CC, bits, &s.ncounter);
-	bits.clear();
-	bits << 2 << 3 << 4 << 5 << 6;
-	fillField(N_ACOUNTER_DIVIDER, bits, &s.ncounter);
-	bits.clear();
-	bits << 7 << 8 << 9 << 10 << 11 << 12 << 13 << 14 << 15 << 16 << 17 << 18 << 19;
-	fillField(N_BCOUNTER_DIVIDER, bits, &s.ncounter);
-	bits.clear();
-	bits << 20;
-	fillField(N_CPGAIN_BIT, bits, &s.ncounter);
-	bits.clear();
-	bits << 2;
-	fillField(L_COUNTER_RESET, bits, &s.latches);
-	bits.clear();
-	bits << 3;
-	fillField(L_POWER_DOWN, bits, &s.latches);
-	bits.clear();
-	bits << 4<<5<<6;
-	fillField(L_FO_LD, bits, &s.latches);
-	bits.clear();
-	bits << 7;
-	fillField(L_PH_DET_POLARITY, bits, &s.latches);
-	bits.clear();
-	bits << 8;
-	fillField(L_CP, bits, &s.latches);
-	bits.clear();
-	bits << 9<<10<<11;
-	fillField(L_FASTLOCK, bits, &s.latches);
-	bits.clear();
-	bits << 12<<13<<14<<15;
-	fillField(L_TIMEOUT, bits, &s.latches);
-	bits.clear();
-	bits << 16<<17<<18;
-	fillField(L_TESTMODES, bits, &s.latches);
-	bits.clear();
-	bits << 19;
-	fillField(L_POWER_DOWN_MODE, bits, &s.latches);
-	bits.clear();
-	bits << 20;
-	fillField(L_TESTMODE, bits, &s.latches);
-	setFieldRegister(L_CC, (int)control_field::FUNCTION_LATCH);
-	setFieldRegister(L_FO_LD, (int)FoLD_field::R_DIVIDER_OUT);
+	setField<L_CC>(s.latches, quint64(control_field::FUNCTION_LATCH));
+	setField<L_FO_LD>(s.latches, quint64(FoLD_field::R_DIVIDER_OUT));
 
 	devicePin *pin = new devicePin;
 	pin->name = "Data";
@@ -93,41 +39,34 @@ hardwareDevice::clockType lmx2326::getClk_type() const
 	return hardwareDevice::CLOCK_RISING_EDGE;
 }
 
-bool lmx2326::processNewScan()
+void lmx2326::prepareScan(quint32 steps, const msa::scanSnapshot &scan)
 {
+	genericPLL::prepareScan(steps, scan);
+}
 
-	bool error;
-	bool hasError = false;
+bool lmx2326::processStepRange(quint32 first, quint32 last, quint32 slot)
+{
 	bool hasFatalError = false;
 	//qDebug() << "lmx2326 starting processNewScan";
-	double ncounter = 0;
-	double Bcounter = 0;
-	double Acounter = 0;
-	QList<quint32> index;
-	index.append(msa::getInstance().currentScan.steps->keys());
-	std::sort(index.begin(), index.end());
-
-	foreach (quint32 step, index) {
-		if(initIndexes.contains(step))
-				continue;
-		ncounter = parser->parsePLLNCounter(msa::getInstance().currentScan.configuration, (*msa::getInstance().currentScan.steps)[step],step, error, hasFatalError);
-		if(error)
-			hasError = true;
-		Bcounter = floor(ncounter/32);
-		Acounter = round(ncounter-(Bcounter*32));
-		if(Acounter < 0 || Acounter > 31 || Bcounter < 3 || Bcounter > 8191 || Acounter > Bcounter) {
+	quint32 count = last - first;
+	QVector<double> ncounter(int(count));
+	bool hasError = parser->parsePLLRange(snapshot->configuration, snapshot->steps.data(), getRCounter(),
+										  first, last, ncounter.data(), pfd.data() + slot, hasFatalError);
+	const quint64 ncounterBase = N_CC::encode(quint64(control_field::NCOUNTER)) | N_CPGAIN_BIT::encode(quint64(cp_gain::HIGH));//Phase Det Current, 1= 1 ma, 0= 250 ua
+	bool debug = (parser->getDevice() == msa::PLL1) && (getInstrument().currentInterface->getDebugLevel() > 2);
+
+	for (quint32 i = 0; i < count; ++i) {
+		quint32 step = first + i;
+		double Bcounter = floor(ncounter.at(int(i))/32);
+		double Acounter = round(ncounter.at(int(i))-(Bcounter*32));
+		// reported to the user by planValidator before the compilation
+		if(!checkNCounter(Acounter, Bcounter))
 			hasError = true;
-			msa::getInstance().currentInterface->errorOcurred(parser->getDevice(), QString("There was a problem with the PLL register settings for step %1").arg(step), hasFatalError, false);
-		}
-		setFieldRegister(N_ACOUNTER_DIVIDER, quint32(Acounter));
-		setFieldRegister(N_BCOUNTER_DIVIDER, quint32(Bcounter));
-		setFieldRegister(N_CC, int(control_field::NCOUNTER));
-		setFieldRegister(N_CPGAIN_BIT, int(cp_gain::HIGH));//Phase Det Current, 1= 1 ma, 0= 250 ua
-		registerToBuffer(&s.ncounter, PIN_DATA, step);
-		addLEandCLK(step);
-		config[step] = s;
-		if(parser->getDevice() == msa::PLL1 && msa::getInstance().currentInterface->getDebugLevel() > 2) {
-			qDebug() << "PLL1 step:"<< step <<" acounter:"<<Acounter<<" bcounter:"<< Bcounter<<" ARR:" <<convertToStr(&s.ncounter) << s.ncounter;
+		// every other ncounter field is constant during the scan
+		quint64 ncounterWord = ncounterBase | N_ACOUNTER_DIVIDER::encode(quint64(Acounter)) | N_BCOUNTER_DIVIDER::encode(quint64(Bcounter));
+		stepRegisters[int(slot + i)] = ncounterWord;
+		if(debug) {
+			qDebug() << "PLL1 step:"<< step <<" acounter:"<<Acounter<<" bcounter:"<< Bcounter<<" ARR:" <<convertToStr(ncounterWord, ncounterFields()) << ncounterWord;
 		}
 	}
 	return hasError;
@@ -137,33 +76,37 @@ bool lmx2326::init()
 {
 	bool error;
 	bool fatalError;
-	setFieldRegister(R_CC, int(control_field::RCOUNTER));
-	setFieldRegister(N_CC, int(control_field::NCOUNTER));
-	setFieldRegister(L_CC, int(control_field::INIT));
-	setFieldRegister(L_POWER_DOWN_MODE, 0);
-	setFieldRegister(L_COUNTER_RESET, 0);
-	setFieldRegister(L_POWER_DOWN, 0);
+	// programmed for the scan started last, with the instrument configuration before the first one
+	msa::scanSnapshot scan = getInstrument().getSnapshot();
+	const msa::scanConfig &configuration = scan ? scan->configuration : getInstrument().getScanConfiguration();
+	const scanPlan *plan = scan ? scan->steps.data() : getInstrument().currentScan.steps.data();
+	setField<R_CC>(s.rcounter, quint64(control_field::RCOUNTER));
+	setField<N_CC>(s.ncounter, quint64(control_field::NCOUNTER));
+	setField<L_CC>(s.latches, quint64(control_field::INIT));
+	setField<L_POWER_DOWN_MODE>(s.latches, 0);
+	setField<L_COUNTER_RESET>(s.latches, 0);
+	setField<L_POWER_DOWN>(s.latches, 0);
 	switch (parser->getDevice()) {
 	case msa::PLL1:
-		setFieldRegister(L_FO_LD, msa::getInstance().getScanConfiguration().PLL1pin14Output);
+		setField<L_FO_LD>(s.latches, configuration.PLL1pin14Output);
 		break;
 	case msa::PLL3:
-		setFieldRegister(L_FO_LD, msa::getInstance().getScanConfiguration().PLL3pin14Output);
+		setField<L_FO_LD>(s.latches, configuration.PLL3pin14Output);
 		break;
 	default:
-		setFieldRegister(L_FO_LD, quint32(FoLD_field::TRI_STATE));
+		setField<L_FO_LD>(s.latches, quint64(FoLD_field::TRI_STATE));
 		break;
 	}
-	if(parser->getPLLinverted((msa::getInstance().currentScan.configuration)))
-		setFieldRegister(L_PH_DET_POLARITY, int(phase_detector::INVERTED));
+	if(parser->getPLLinverted(configuration))
+		setField<L_PH_DET_POLARITY>(s.latches, quint64(phase_detector::INVERTED));
 	else
-		setFieldRegister(L_PH_DET_POLARITY, int(phase_detector::NON_INVERTED));
-	setFieldRegister(L_CP, int(cp_tri_state::NORMAL));
-	setFieldRegister(L_FASTLOCK, 0);
-	setFieldRegister(L_TIMEOUT, 0);
-	setFieldRegister(L_TESTMODES, 0);
-	setFieldRegister(L_POWER_DOWN_MODE, 0);
-	setFieldRegister(L_TESTMODE, 0);
+		setField<L_PH_DET_POLARITY>(s.latches, quint64(phase_detector::NON_INVERTED));
+	setField<L_CP>(s.latches, quint64(cp_tri_state::NORMAL));
+	setField<L_FASTLOCK>(s.latches, 0);
+	setField<L_TIMEOUT>(s.latches, 0);
+	setField<L_TESTMODES>(s.latches, 0);
+	setField<L_POWER_DOWN_MODE>(s.latches, 0);
+	setField<L_TESTMODE>(s.latches, 0);
 	registerToBuffer(&s.latches, PIN_DATA, HW_INIT_STEP);
 	addLEandCLK(HW_INIT_STEP);
 	//qDebug() << "lmx2326 initData" << *devicePins.value(PIN_DATA)->data.value(HW_INIT_STEP).dataArray;
@@ -178,28 +121,28 @@ bool lmx2326::init()
 	initIndexes.clear();
 	initIndexes.append(HW_INIT_STEP);
 	config[HW_INIT_STEP] = s;
-	double rcounter = parser->parsePLLRCounter(msa::getInstance().currentScan.configuration);//10.7/0.974 = 11
+	double rcounter = parser->parsePLLRCounter(configuration);//10.7/0.974 = 11
 	//qDebug()<<"RCOUNTER"<<rcounter;
-    setFieldRegister(R_DIVIDER, quint32(rcounter));
-	setFieldRegister(R_LD, 0);
-	setFieldRegister(R_TESTMODES, 0);
+	if(!checkRCounter(rcounter))
+		getInstrument().currentInterface->errorOcurred(parser->getDevice(), QString("There was a problem with the PLL R counter setting %1").arg(rcounter), false, false);
+	setField<R_DIVIDER>(s.rcounter, quint64(rcounter));
+	setField<R_LD>(s.rcounter, 0);
+	setField<R_TESTMODES>(s.rcounter, 0);
 	registerToBuffer(&s.rcounter, PIN_DATA, HW_INIT_STEP -1);
-	//qDebug() << "LMX2326 SCAN_INIT_STEP rcounter:" << convertToStr(&s.rcounter) << rcounter;
+	//qDebug() << "LMX2326 SCAN_INIT_STEP rcounter:" << convertToStr(s.rcounter, rcounterFields()) << rcounter;
 	//qDebug() << "LMX2326 SCAN_INIT_STEP PIN_DATA dataArray:" << *devicePins.value(PIN_DATA)->data.value(HW_INIT_STEP-1).dataArray;
 	addLEandCLK(HW_INIT_STEP - 1);
 	config[HW_INIT_STEP - 1] = s;
 	initIndexes.append(HW_INIT_STEP - 1);
-	msa::scanStep st;
-	msa::getInstance().currentScan.steps->insert(HW_INIT_STEP, st);
-	double ncounter = parser->parsePLLNCounter(msa::getInstance().currentScan.configuration, (*msa::getInstance().currentScan.steps)[HW_INIT_STEP],HW_INIT_STEP, error, fatalError);
+	double ncounter = parser->parsePLLNCounter(configuration, plan, HW_INIT_STEP, error, fatalError);
 	if(ncounter > 0) {
 		double Bcounter = floor(ncounter/32);
 		double Acounter = round(ncounter-(Bcounter*32));
 		//qDebug() << "PLL2 Acounter" << Acounter << "Bcounter" << Bcounter;
-		setFieldRegister(N_ACOUNTER_DIVIDER, quint32(Acounter));
-		setFieldRegister(N_BCOUNTER_DIVIDER, quint32(Bcounter));
-		setFieldRegister(N_CC, int(control_field::NCOUNTER));
-		setFieldRegister(N_CPGAIN_BIT, int(cp_gain::HIGH));//Phase Det Current, 1= 1 ma, 0= 250 ua
+		setField<N_ACOUNTER_DIVIDER>(s.ncounter, quint64(Acounter));
+		setField<N_BCOUNTER_DIVIDER>(s.ncounter, quint64(Bcounter));
+		setField<N_CC>(s.ncounter, quint64(control_field::NCOUNTER));
+		setField<N_CPGAIN_BIT>(s.ncounter, quint64(cp_gain::HIGH));//Phase Det Current, 1= 1 ma, 0= 250 ua
 		registerToBuffer(&s.ncounter, PIN_DATA, HW_INIT_STEP-2);
 		addLEandCLK(HW_INIT_STEP - 2);
 		initIndexes.append(HW_INIT_STEP - 2);
@@ -220,36 +163,32 @@ lmx2326::~lmx2326()
 
 int lmx2326::getRCounter()
 {
-	return getFieldRegister(R_DIVIDER);
-}
-
-bool lmx2326::checkSettings()
-{
-	if(getFieldRegister(N_ACOUNTER_DIVIDER) > getFieldRegister(N_BCOUNTER_DIVIDER))
-		return false;
-	else if(getFieldRegister(N_BCOUNTER_DIVIDER) < 3)
-		return false;
-	else if(getFieldRegister(R_DIVIDER) < 3)
-		return false;
-	return true;
+	return int(R_DIVIDER::get(s.rcounter));
 }
 
 QHash<quint32, lmx2326_struct> lmx2326::getConfig() const
 {
-	return config;
+	QHash<quint32, lmx2326_struct> ret = config;
+	lmx2326_struct st = s;
+	for(int step = 0; step < stepRegisters.size(); ++step) {
+		st.ncounter = stepRegisters.at(step);
+		ret.insert(quint32(step), st);
+	}
+	return ret;
 }
 
 double lmx2326::getVcoFrequency(double external_clock_frequency)
 {
 	double ret;
-	ret = ((double)32 * (double)getFieldRegister(N_BCOUNTER_DIVIDER)+ (double)getFieldRegister(N_ACOUNTER_DIVIDER)) * (external_clock_frequency / (double)getFieldRegister(R_DIVIDER));
+	ret = ((double)32 * (double)N_BCOUNTER_DIVIDER::get(s.ncounter)+ (double)N_ACOUNTER_DIVIDER::get(s.ncounter)) * (external_clock_frequency / (double)R_DIVIDER::get(s.rcounter));
 	return ret;
 }
 
 bool lmx2326::addLEandCLK(quint32 step)
 {
 	int totalSize = registerSize + 2;
-	resizePinData(&devicePins.value(PIN_DATA)->data[step], totalSize);
+	pin_data data = devicePins.value(PIN_DATA)->data.value(step);
+	resizePinData(&data, totalSize);
 	devicePin *vclk = devicePins.value(PIN_VIRTUAL_CLOCK);
 	if(!vclk->data.contains(step)) {
 		vclk->data.insert(step, createPinData(totalSize));
@@ -22,33 +22,58 @@ public:
 	lmx2326(msa::MSAdevice device, QObject *parent);
 
 	clockType getClk_type() const;
-	bool processNewScan();
+	void prepareScan(quint32 steps, const msa::scanSnapshot &scan);
+	bool processStepRange(quint32 first, quint32 last, quint32 slot);
 	bool init();
 	void reinit();
 	~lmx2326();
 	int getRCounter();
 	typedef enum {PIN_CLK, PIN_DATA, PIN_LE, PIN_VIRTUAL_CLOCK} pins;
+	// function of the FoLD (pin 14) output
+	enum class FoLD_field {TRI_STATE=0, R_DIVIDER_OUT=4, N_DIVIDER_OUT=2, SERIAL_DATA_OUT=6, DIGITAL_LOCK_DETECT=1, nCHANNEL_OPEN_DRAIN_LOCK_DETECT=5, ACTIVE_HIGH=3, ACTIVE_LOW=7};
 	QHash<quint32, lmx2326_struct> getConfig() const;
+	// range checks done on the counter values before they are encoded
+	static constexpr bool checkNCounter(double acounter, double bcounter) {
+		return (acounter >= 0) && (acounter <= N_ACOUNTER_DIVIDER::maximum()) && (bcounter >= 3)
+				&& (bcounter <= N_BCOUNTER_DIVIDER::maximum()) && (acounter <= bcounter);
+	}
 
 protected:
 private:
 	void loadRcounterCC(int value);
 	lmx2326_struct s;
+	// register maps, bit numbering follows ADF4118 datasheet, LMX2326 is inverted
 	// the first letter(s) denotes the register to which the field belongs (ex:r means rcounter)
-	typedef enum {
-	R_CC, R_LD, R_DIVIDER, R_TESTMODES,
-	N_CC, N_ACOUNTER_DIVIDER, N_BCOUNTER_DIVIDER, N_CPGAIN_BIT,
-	L_CC, L_COUNTER_RESET, L_POWER_DOWN, L_FO_LD, L_PH_DET_POLARITY, L_CP, L_FASTLOCK, L_TIMEOUT, L_TESTMODES, L_POWER_DOWN_MODE, L_TESTMODE}fields_type;
+	typedef registerField<0, 2> R_CC;
+	typedef registerField<2, 14> R_DIVIDER;
+	typedef registerField<16, 4> R_TESTMODES;
+	typedef registerField<20, 1> R_LD;
+	typedef registerField<0, 2> N_CC;
+	typedef registerField<2, 5> N_ACOUNTER_DIVIDER;
+	typedef registerField<7, 13> N_BCOUNTER_DIVIDER;
+	typedef registerField<20, 1> N_CPGAIN_BIT;
+	typedef registerField<0, 2> L_CC;
+	typedef registerField<2, 1> L_COUNTER_RESET;
+	typedef registerField<3, 1> L_POWER_DOWN;
+	typedef registerField<4, 3> L_FO_LD;
+	typedef registerField<7, 1> L_PH_DET_POLARITY;
+	typedef registerField<8, 1> L_CP;
+	typedef registerField<9, 3> L_FASTLOCK;
+	typedef registerField<12, 4> L_TIMEOUT;
+	typedef registerField<16, 3> L_TESTMODES;
+	typedef registerField<19, 1> L_POWER_DOWN_MODE;
+	typedef registerField<20, 1> L_TESTMODE;
+	static constexpr quint64 ncounterFields() {return N_CC::end() | N_ACOUNTER_DIVIDER::end() | N_BCOUNTER_DIVIDER::end();}
+	static constexpr quint64 rcounterFields() {return R_CC::end() | R_DIVIDER::end() | R_TESTMODES::end();}
 
 	enum class control_field {RCOUNTER=0, NCOUNTER=1, FUNCTION_LATCH=2, INIT=3};
-	enum class FoLD_field {TRI_STATE=0, R_DIVIDER_OUT=4, N_DIVIDER_OUT=2, SERIAL_DATA_OUT=6, DIGITAL_LOCK_DETECT=1, nCHANNEL_OPEN_DRAIN_LOCK_DETECT=5, ACTIVE_HIGH=3, ACTIVE_LOW=7};
 	enum class phase_detector {NON_INVERTED=1, INVERTED=0};
 	enum class cp_gain {LOW = 0, HIGH};//250uA, 1ma
 	enum class cp_tri_state {NORMAL, TRI_STATE};
 	// returns VCO frequency based on the current register values
 	double getVcoFrequency(double external_clock_frequency);
 	bool addLEandCLK(quint32 step);
-	bool checkSettings();
+	static constexpr bool checkRCounter(double rcounter) {return (rcounter >= 3) && (rcounter <= R_DIVIDER::maximum());}
 	QHash<quint32,lmx2326_struct> config;
 };
 #endif // LMX2326_H
@@ -29,9 +29,17 @@
 #include "lmx2326.h"
 #include "controllers/interface.h"
 #include "hardwaredevice.h"
+#include "scanplan.h"
+#include "planvalidator.h"
+#include "frequencykernel.h"
 #include <QDebug>
 #include "mainwindow.h"
 
+msa::msa():currentInterface(nullptr), isInverted(false), resolution_filter_bank(0), mw(nullptr)
+{
+	currentScan.steps = QSharedPointer<const scanPlan>(new scanPlan());
+}
+
 bool msa::getIsInverted() const
 {
 	return isInverted;
@@ -56,6 +64,7 @@ void msa::setMainWindow(MainWindow *window)
 void msa::hardwareInit(QHash<MSAdevice, int> devices, interface *usedInterface)
 {
 	currentInterface = usedInterface;
+	usedInterface->setInstrument(this);
 	foreach(hardwareDevice * dev, currentHardwareDevices.values()) {
 		delete dev;
 	}
@@ -88,9 +97,14 @@ bool msa::initScan(ComProtocol::msg_scan_config msg) {
 
 bool msa::initScan(bool inverted, double start, double end, quint32 steps, int band)
 {
+	// a running scan keeps going while the next one is compiled and is replaced at the end of its sweep
+	bool staged = currentInterface->canStageScan(steps);
 	interface::status statBack = currentInterface->getCurrentStatus();
-	currentInterface->setStatus(interface::status_halted);
-	msa::scanConfig cfg = msa::getInstance().getScanConfiguration();
+	if(!staged)
+		currentInterface->setStatus(interface::status_halted);
+	msa::scanConfig cfg = getScanConfiguration();
+	// the path setScanConfiguration() will select, the plan and the staged scan are built with it
+	selectPathCalibration(cfg, cfg.currentFinalFilterName);
 	if(qFuzzyCompare(start, end)) {// for zero span
 		cfg.gui.start = 0;
 		cfg.gui.stop = steps;
@@ -102,29 +116,30 @@ bool msa::initScan(bool inverted, double start, double end, quint32 steps, int b
 	cfg.gui.steps_number = steps;
 	cfg.gui.band = band;
 	//TODO CalculateAllStepsForLO3Synth
-	msa::getInstance().currentScan.steps->clear();
+	// a new plan, the previous ones stay whole for the sweeps and samples still using them
+	QSharedPointer<scanPlan> plan(new scanPlan());
+	plan->allocate(steps);
 	double step = (end - start) / double(steps);
-	if(step > msa::getInstance().currentScan.configuration.pathCalibration.bandwidth_MHZ)
-		msa::getInstance().currentInterface->errorOcurred(msa::MSA, "Frequency step size exceeds final filter bandwidth signals may be missed.", false, true);
 	if(qFuzzyCompare(start, end))// for zero span
 		cfg.gui.step_freq = 1;
 	else
 		cfg.gui.step_freq = step;
-	msa::getInstance().setScanConfiguration(cfg);
 	int thisBand = 0;
 	int bandSelect = 0;
-    for(quint32 x = 0; x < steps; ++x) {
-		msa::scanStep s;
-		s.realFrequency = start + (x * step);
+	double *realFrequency = plan->realFrequency.data();
+	double *translatedFrequency = plan->translatedFrequency.data();
+	int *stepBand = plan->band.data();
+	for(quint32 x = 0; x < steps; ++x) {
+		double realFreq = start + (x * step);
 		if(band < 0) {
-			if(s.realFrequency < 1000)
+			if(realFreq < 1000)
 				thisBand = 1;
-			else if(s.realFrequency < 2000)
+			else if(realFreq < 2000)
 				thisBand = 2;
 			else
 				thisBand = 3;
 		}
-		s.translatedFrequency = s.realFrequency;
+		double translatedFreq = realFreq;
 		double IF1;
 		if(band < 0)
 			bandSelect = thisBand;
@@ -132,26 +147,51 @@ bool msa::initScan(bool inverted, double start, double end, quint32 steps, int b
 			bandSelect = band;
 		switch (bandSelect) {
 		case 2:
-			s.translatedFrequency = s.translatedFrequency - msa::getInstance().currentScan.configuration.LO2;
+			translatedFreq = translatedFreq - cfg.LO2;
 			break;
 		case 3:
-			IF1 = msa::getInstance().currentScan.configuration.LO2 - msa::getInstance().currentScan.configuration.pathCalibration.centerFreq_MHZ;
-			s.translatedFrequency = s.translatedFrequency - 2*IF1;
+			IF1 = cfg.LO2 - cfg.pathCalibration.centerFreq_MHZ;
+			translatedFreq = translatedFreq - 2*IF1;
 			break;
 		default:
 			break;
 		}
-		s.band = bandSelect;
 		//qDebug() << start << end << steps;
-		//qDebug() << "step:" << x << "real frequency:" << s.realFrequency << "translated frequency:" << s.translatedFrequency;
-		msa::getInstance().currentScan.steps->insert(x, s);
+		//qDebug() << "step:" << x << "real frequency:" << realFreq << "translated frequency:" << translatedFreq;
+		realFrequency[x] = realFreq;
+		translatedFrequency[x] = translatedFreq;
+		stepBand[x] = bandSelect;
 	}
+	// the compilation reads the LOs from the plan
+	frequencyKernel::LO1(translatedFrequency, cfg.baseFrequency, cfg.LO2, cfg.pathCalibration.centerFreq_MHZ, plan->LO1.data(), steps);
+	frequencyKernel::fill(frequencyKernel::LO3(cfg), plan->LO3.data(), steps);
+	frequencyKernel::settleTimes(plan->LO1.constData(), stepBand, steps, inverted, cfg.settling, plan->settle_us.data());
+	// all the hardware limits are checked here once, a scan that can't be run is not compiled
+	// and doesn't replace the current one, which goes on as it was
+	planValidator::report validation = planValidator::validate(cfg, plan.data(), currentHardwareDevices);
+	if(!validation.isEmpty())
+		currentInterface->errorOcurred(msa::MSA, validation.toString(), validation.isFatal(), true);
+	if(validation.isFatal()) {
+		if(!staged)
+			currentInterface->setStatus(statBack);
+		return false;
+	}
+	extrapolateFrequencyCalibration(cfg, plan.data());
+	scanSnapshot scan = makeSnapshot(cfg, inverted, plan);
+	// a staged scan is compiled before anything is switched, when it fails the instrument keeps the running one
+	if(staged && !currentInterface->stageScan(scan))
+		return false;
+	setScanConfiguration(cfg);
 	isInverted = inverted;
-	extrapolateFrequenctCalibrationForCurrentScan();
-	foreach(std::function<void(scanConfig)> c, scanConfigChangedCallbacks) {
+	currentScan.steps = plan;
+	foreach(const std::function<void(const scanConfig &)> &c, scanConfigChangedCallbacks) {
 		c(cfg);
 	}
-	bool ret = currentInterface->initScan();
+	publishSnapshot(scan);
+	if(staged)
+		return true;
+	// compiled on the acquisition thread, which is halted, the thread itself is kept
+	bool ret = currentInterface->replan();
 	if(ret)
 		currentInterface->setStatus(statBack);
 	return ret;
@@ -164,73 +204,95 @@ bool msa::initScan(bool inverted, double start, double end, double step_freq, in
 }
 
 
-msa::scanConfig msa::getScanConfiguration()
+const msa::scanConfig &msa::getScanConfiguration() const
 {
-	return msa::getInstance().currentScan.configuration;
+	return currentScan.configuration;
 }
 
-void msa::setScanConfiguration(msa::scanConfig configuration)
+msa::scanSnapshot msa::getSnapshot() const
 {
-	interface::status s = interface::status_halted;
-	if(currentInterface) {
-		s = currentInterface->getCurrentStatus();
-		currentInterface->setStatus(interface::status_halted);
-	}
-	msa::getInstance().currentScan.configuration = configuration;
-	bool found = msa::getInstance().setPathCalibrationAndExtrapolate(configuration.currentFinalFilterName);
-	if(found)
-		mw->triggerMessage(INFO, QString("%1 path chosen").arg(configuration.currentFinalFilterName), QString("Center:%1MHz Bandwidth:%2MHz").arg(msa::getInstance().getScanConfiguration().pathCalibration.centerFreq_MHZ).arg(msa::getInstance().getScanConfiguration().pathCalibration.bandwidth_MHZ), 7);
-	else
+	QMutexLocker locker(&snapshotLock);
+	return snapshot;
+}
+
+msa::scanSnapshot msa::makeSnapshot(const scanConfig &configuration, bool inverted, const QSharedPointer<const scanPlan> &plan) const
+{
+	scanSnapshotData *data = new scanSnapshotData;
+	data->configuration = configuration;
+	data->inverted = inverted;
+	data->resolution_filter_bank = resolution_filter_bank;
+	data->frequencyCal = plan->frequencyCal;
+	data->steps = plan;
+	return scanSnapshot(data);
+}
+
+void msa::publishSnapshot(scanSnapshot taken)
+{
+	QMutexLocker locker(&snapshotLock);
+	// the previous one is freed by the last sweep still using it
+	snapshot.swap(taken);
+}
+
+void msa::setScanConfiguration(const msa::scanConfig &configuration)
+{
+	// the acquisition only reads the snapshots of the scans started, it is not stopped
+	currentScan.configuration = configuration;
+	bool found = setPathCalibrationAndExtrapolate(configuration.currentFinalFilterName);
+	// instruments without a window have nowhere to show the messages
+	if(mw && found)
+		mw->triggerMessage(INFO, QString("%1 path chosen").arg(configuration.currentFinalFilterName), QString("Center:%1MHz Bandwidth:%2MHz").arg(getScanConfiguration().pathCalibration.centerFreq_MHZ).arg(getScanConfiguration().pathCalibration.bandwidth_MHZ), 7);
+	else if(mw)
 		mw->triggerMessage(INFO, "There was a problem setting the path in use", "the path was not found", 7);
-	if(currentInterface)
-		currentInterface->setStatus(s);
 }
 
-void msa::extrapolateFrequenctCalibrationForCurrentScan() {
-	QList<quint32> ksteps = msa::getInstance().currentScan.steps->keys();
-	QList<double> fcsteps = msa::getInstance().currentScan.configuration.frequencyCalibration.freqToPower.keys();
-	QHash<double, double> fTod = msa::getInstance().currentScan.configuration.frequencyCalibration.freqToPower;
-	std::sort(ksteps.begin(), ksteps.end());
+void msa::extrapolateFrequencyCalibration(const scanConfig &configuration, scanPlan *plan) {
+	const QHash<double, double> &fTod = configuration.frequencyCalibration.freqToPower;
+	double *frequencyCal = plan->frequencyCal.data();
+	if(fTod.isEmpty()) {
+		std::fill(frequencyCal, frequencyCal + plan->size(), 0.0);
+		return;
+	}
+	QList<double> fcsteps = fTod.keys();
 	std::sort(fcsteps.begin(), fcsteps.end());
-	for (int x = 0; x < ksteps.length(); ++x) {
-		double f = msa::getInstance().currentScan.steps->value(ksteps.at(x)).realFrequency;
-		if(f < fcsteps.first()) {
-			(*(msa::getInstance().currentScan.steps))[ksteps.at(x)].frequencyCal = msa::getInstance().currentScan.configuration.frequencyCalibration.freqToPower.value(fcsteps.first());
-		}
-		else if(f > fcsteps.last()) {
-			(*(msa::getInstance().currentScan.steps))[ksteps.at(x)].frequencyCal = msa::getInstance().currentScan.configuration.frequencyCalibration.freqToPower.value(fcsteps.last());
-		}
-		else {
-			for (int y = 0; y < fcsteps.length(); ++y) {
-				if(fcsteps.at(y) == f) {
-					(*msa::getInstance().currentScan.steps)[(ksteps.at(x))].frequencyCal = fTod.value(fcsteps.at(y));
-					break;
-				}
-//ret.adcToMagCalFactors.value(values.at(int(y))).dbm_val - double(values.at(int(y)) - x)*(ret.adcToMagCalFactors.value(values.at(int(y))).dbm_val - ret.adcToMagCalFactors.value(values.at(int(y -1))).dbm_val) / double(values.at(int(y))-values.at(int(y - 1)));
-				else if(fcsteps.at(y) > f) {
-					if(y == 0)
-						continue;
-					double ff = fTod.value(fcsteps.at(int(y)))
-							- double(fcsteps.at(int(y)) - f) *
-							(fTod.value(fcsteps.at(int(y))) - fTod.value(fcsteps.at(int(y -1)))) /
-							double(fcsteps.at(int(y))-fcsteps.at(int(y - 1)));
-					(*msa::getInstance().currentScan.steps)[(ksteps.at(x))].frequencyCal = ff;
-					break;
-				}
-			}
-		}
+	QVector<double> fcvalues;
+	fcvalues.reserve(fcsteps.size());
+	foreach (double f, fcsteps)
+		fcvalues.append(fTod.value(f));
+	const double *realFrequency = plan->realFrequency.constData();
+	int points = fcsteps.size();
+	// the steps are monotonic, y only moves forward (or backward) and the whole scan is one merge:
+	// fcsteps.at(y) is the first calibration point at or above the step frequency
+	int y = 0;
+	for (quint32 x = 0; x < plan->size(); ++x) {
+		double f = realFrequency[x];
+		while((y < points) && (fcsteps.at(y) < f))
+			++y;
+		while((y > 0) && (fcsteps.at(y - 1) >= f))
+			--y;
+		if(y == points)
+			frequencyCal[x] = fcvalues.last();
+		else if((y == 0) || (fcsteps.at(y) == f))
+			frequencyCal[x] = fcvalues.at(y);
+		else
+			frequencyCal[x] = fcvalues.at(y)
+					- (fcsteps.at(y) - f) * (fcvalues.at(y) - fcvalues.at(y - 1)) / (fcsteps.at(y) - fcsteps.at(y - 1));
 	}
 }
 
-void msa::addScanConfigChangedCallback(std::function<void(scanConfig)> callback)
+void msa::addScanConfigChangedCallback(std::function<void(const scanConfig &)> callback)
 {
 	scanConfigChangedCallbacks.append(callback);
 }
 bool msa::setPathCalibrationAndExtrapolate(QString pathName)
+{
+	return selectPathCalibration(currentScan.configuration, pathName);
+}
+
+bool msa::selectPathCalibration(scanConfig &configuration, const QString &pathName)
 {
 	bool found = false;
 	calParser::magPhaseCalData ret;
-	foreach (calParser::magPhaseCalData data, msa::getInstance().currentScan.configuration.pathCalibrationList) {
+	foreach (calParser::magPhaseCalData data, configuration.pathCalibrationList) {
 		if(data.pathName.contains(pathName)) {
 			ret = data;
 			found = true;
@@ -239,30 +301,7 @@ bool msa::setPathCalibrationAndExtrapolate(QString pathName)
 	}
 	if(!found)
 		return false;
-	msa::getInstance().currentScan.configuration.pathCalibration = ret;
-	msa::getInstance().currentScan.configuration.pathCalibration.adcToMagCalFactors.clear();
-	QList<uint> values = ret.adcToMagCalFactors.keys();
-	std::sort(values.begin(), values.end());
-	for(uint x = 0; x < 0xFFFF; ++x) {
-		if(x < values.first())
-			msa::getInstance().currentScan.configuration.pathCalibration.adcToMagCalFactors.insert(x, ret.adcToMagCalFactors.value(values.first()));
-		else if(x > values.last())
-			msa::getInstance().currentScan.configuration.pathCalibration.adcToMagCalFactors.insert(x, ret.adcToMagCalFactors.value(values.last()));
-		else {
-			for(uint y = 0; y < uint(values.length()); ++y) {
-				if(x == values.at(int(y))) {
-					msa::getInstance().currentScan.configuration.pathCalibration.adcToMagCalFactors.insert(x, ret.adcToMagCalFactors.value(values.at(int(y))));
-					break;
-				}
-				if(values.at(int(y)) > x) {
-					calParser::magCalFactors fact;
-					fact.dbm_val = ret.adcToMagCalFactors.value(values.at(int(y))).dbm_val - double(values.at(int(y)) - x)*(ret.adcToMagCalFactors.value(values.at(int(y))).dbm_val - ret.adcToMagCalFactors.value(values.at(int(y -1))).dbm_val) / double(values.at(int(y))-values.at(int(y - 1)));
-					fact.phase_val = ret.adcToMagCalFactors.value(values.at(int(y))).phase_val - (values.at(int(y)) - x)*(ret.adcToMagCalFactors.value(values.at(int(y))).phase_val - ret.adcToMagCalFactors.value(values.at(int(y -1))).phase_val) / (values.at(int(y))-values.at(int(y - 1)));
-					msa::getInstance().currentScan.configuration.pathCalibration.adcToMagCalFactors.insert(x, fact);
-					break;
-				}
-			}
-		}
-	}
+	configuration.pathCalibration = ret;
+	configuration.pathCalibrationTable.build(ret.adcToMagCalFactors);
 	return true;
 }
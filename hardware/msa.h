@@ -27,18 +27,26 @@
 #define MSA_H
 
 #include <QHash>
+#include <QVector>
+#include <QSharedPointer>
+#include <QMutex>
 #include "../shared/comprotocol.h"
 #include "calparser.h"
+#include "calibrationtable.h"
 
 typedef enum {INFO, WARNING, ERROR} message_type;
 
 class MainWindow;
 class hardwareDevice;
 class interface;
+class scanPlan;
 class msa
 {
 public:
 	typedef enum {PLL1, PLL2, PLL3, DDS1, DDS3, ADC_MAG, ADC_PH, MSA} MSAdevice;
+	// Each instrument is one msa, with its own interface, devices, scan and calibration.
+	// The default instrument is the one driven by the GUI, others are created directly.
+	msa();
 	static msa& getInstance()
 	{
 		static msa    instance;
@@ -47,7 +55,6 @@ public:
 	QHash<msa::MSAdevice, hardwareDevice *> currentHardwareDevices;
 	interface *currentInterface;
 private:
-	msa() {}
 	bool isInverted;
 	int resolution_filter_bank;
 	MainWindow *mw;
@@ -75,6 +82,16 @@ public:
 		double outputFreq;
 		double oscFreq;
 	} forceDDS;
+	// time the LOs take to settle after a step, the write/read delay is the upper bound
+	typedef struct {
+		bool adaptive; // false: every step waits the whole write/read delay
+		double minimum_us; // DDS only change, also the wait of the smallest PLL step
+		double PLL_us_per_MHz; // added per MHz of LO jump
+		bool closedLoop; // polls the PLLs lock detect instead, the settle time becomes the timeout
+		int lockPort; // status reply port with the lock detect lines, 0=port_A ... 4=port_E
+		uint8_t PLL1lockMask; // lock detect bit(s) of each PLL in lockPort
+		uint8_t PLL3lockMask;
+	} settlingModel;
 //        typedef  struct {
 //            int address;
 //            double centerFrequency;
@@ -86,6 +103,7 @@ public:
 		calParser::freqCalData frequencyCalibration;
 		QList<calParser::magPhaseCalData> pathCalibrationList;
 		calParser::magPhaseCalData pathCalibration;
+		calibrationTable pathCalibrationTable; // pathCalibration for every ADC code
 		QString currentFinalFilterName;
 		QString currentVideoFilterName;
 		double baseFrequency;
@@ -110,26 +128,51 @@ public:
 		ComProtocol::msg_scan_config gui;
 		forceDDS forcedDDS1;
 		forceDDS forcedDDS3;
+		settlingModel settling;
+		double sweepTime_ms; // fixed duration of a sweep, 0 = as fast as the settle times allow
                 bool cavityTestRunning;
 	} scanConfig;
 	typedef struct {
 		scanConfig configuration;
-		QHash<quint32, scanStep> *steps;
+		// plan of the scan started last, each scan gets a new one and a published plan is never changed
+		QSharedPointer<const scanPlan> steps;
 	} scanStruct;
+	// what a scan is compiled and acquired with, taken once per scan and never changed,
+	// so the compilation and acquisition threads share it without copies nor locks
+	typedef struct {
+		scanConfig configuration;
+		bool inverted;
+		int resolution_filter_bank;
+		QVector<double> frequencyCal; // frequency calibration of each step, added to the magnitude
+		QSharedPointer<const scanPlan> steps; // the plan built with configuration
+	} scanSnapshotData;
+	typedef QSharedPointer<const scanSnapshotData> scanSnapshot;
 	scanStruct currentScan;
-	void setScanConfiguration(msa::scanConfig configuration);
+	// snapshot of the last scan started, null before the first one
+	scanSnapshot getSnapshot() const;
+	void setScanConfiguration(const msa::scanConfig &configuration);
 	bool initScan(bool inverted, double start, double end, double step_freq, int band = -1);
 	bool initScan(bool inverted, double start, double end, quint32 steps, int band = -1);
 	bool getIsInverted() const;
 	int getResolution_filter_bank() const;
 	void setResolution_filter_bank(int value);
 	void setMainWindow(MainWindow *window);
-	msa::scanConfig getScanConfiguration();
+	const msa::scanConfig &getScanConfiguration() const;
 	bool setPathCalibrationAndExtrapolate(QString pathName);
-	void extrapolateFrequenctCalibrationForCurrentScan();
-	QList<std::function<void(scanConfig)>> scanConfigChangedCallbacks;
-	void addScanConfigChangedCallback(std::function<void(scanConfig)> callback);
+	QList<std::function<void(const scanConfig &)>> scanConfigChangedCallbacks;
+	void addScanConfigChangedCallback(std::function<void(const scanConfig &)> callback);
 	bool initScan(ComProtocol::msg_scan_config msg);
+private:
+	mutable QMutex snapshotLock;
+	scanSnapshot snapshot;
+	// what a scan built with configuration and plan is compiled and acquired with
+	scanSnapshot makeSnapshot(const scanConfig &configuration, bool inverted, const QSharedPointer<const scanPlan> &plan) const;
+	// makes taken the scan returned by getSnapshot()
+	void publishSnapshot(scanSnapshot taken);
+	// sets the path calibration of configuration to the one of pathName, false if there is none
+	static bool selectPathCalibration(scanConfig &configuration, const QString &pathName);
+	// fills the frequency calibration of every step of plan
+	static void extrapolateFrequencyCalibration(const scanConfig &configuration, scanPlan *plan);
 };
 
 #endif // MSA_H
@@ -0,0 +1,100 @@
+/**
+ ******************************************************************************
+ *
+ * @file       main.cpp
+ * @author     Jose Barros (AKA PT_Dreamer) josemanuelbarros@gmail.com 2019
+ * @brief      plancompiler.cpp file
+ * @see        The GNU Public License (GPL) Version 3
+ * @defgroup   planCompiler
+ * @{
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+#include "plancompiler.h"
+#include "hardwaredevice.h"
+#include <QtConcurrent>
+#include <QThread>
+
+// below this a range is not worth a thread
+#define MIN_RANGE_SIZE 512
+
+bool planCompiler::compile(const QList<deviceChain> &chains, const msa::scanSnapshot &scan)
+{
+	quint32 steps = scan->steps->size();
+	prepare(chains, steps, scan);
+	return compileRange(chains, 0, steps, 0);
+}
+
+void planCompiler::prepare(const QList<deviceChain> &chains, quint32 slots, const msa::scanSnapshot &scan)
+{
+	foreach (deviceChain chain, chains) {
+		foreach (hardwareDevice *dev, chain) {
+			if(dev)
+				dev->prepareScan(slots, scan);
+		}
+	}
+}
+
+bool planCompiler::compileRange(const QList<deviceChain> &chains, quint32 first, quint32 last, quint32 slot)
+{
+	QList<QFuture<bool>> futures;
+	foreach (deviceChain chain, chains) {
+		futures.append(QtConcurrent::run(&planCompiler::compileChain, chain, first, last, slot));
+	}
+	bool error = false;
+	for (int x = 0; x < futures.size(); ++x) {
+		error |= futures[x].result();
+	}
+	return error;
+}
+
+bool planCompiler::compileChain(deviceChain chain, quint32 first, quint32 last, quint32 slot)
+{
+	bool error = false;
+	foreach (hardwareDevice *dev, chain) {
+		if(dev)
+			error |= compileDevice(dev, first, last, slot);
+	}
+	return error;
+}
+
+bool planCompiler::compileDevice(hardwareDevice *dev, quint32 first, quint32 last, quint32 slot)
+{
+	QVector<stepRange> ranges = splitSteps(first, last);
+	QtConcurrent::blockingMap(ranges, [dev, first, slot](stepRange &range) {
+		range.error = dev->processStepRange(range.first, range.last, slot + (range.first - first));
+	});
+	bool error = false;
+	foreach (stepRange range, ranges) {
+		error |= range.error;
+	}
+	return error;
+}
+
+QVector<planCompiler::stepRange> planCompiler::splitSteps(quint32 first, quint32 last)
+{
+	QVector<stepRange> ranges;
+	quint32 threads = quint32(qMax(1, QThread::idealThreadCount()));
+	quint32 size = qMax(quint32(MIN_RANGE_SIZE), (last - first + threads - 1) / threads);
+	for (quint32 begin = first; begin < last; begin += size) {
+		stepRange r;
+		r.first = begin;
+		r.last = qMin(last, begin + size);
+		r.error = false;
+		ranges.append(r);
+	}
+	return ranges;
+}
@@ -0,0 +1,60 @@
+/**
+ ******************************************************************************
+ *
+ * @file       main.cpp
+ * @author     Jose Barros (AKA PT_Dreamer) josemanuelbarros@gmail.com 2019
+ * @brief      plancompiler.h file
+ * @see        The GNU Public License (GPL) Version 3
+ * @defgroup   planCompiler
+ * @{
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef PLANCOMPILER_H
+#define PLANCOMPILER_H
+
+#include <QList>
+#include <QVector>
+#include "msa.h"
+
+class hardwareDevice;
+
+// Compiles the scan plan of the hardware devices as a small task graph.
+// Each chain is a list of devices where a device depends on the previous ones
+// (ex: DDS1 needs the PFD table of PLL1), chains run concurrently and each
+// device has its step range split across the available cores.
+class planCompiler
+{
+public:
+	typedef QList<hardwareDevice *> deviceChain;
+	// returns true if any of the devices reported an error, like processNewScan()
+	static bool compile(const QList<deviceChain> &chains, const msa::scanSnapshot &scan);
+	// allocates the per step storage of all devices for scan, slots is the number of steps kept at once
+	static void prepare(const QList<deviceChain> &chains, quint32 slots, const msa::scanSnapshot &scan);
+	// compiles steps [first, last[ into the device storage starting at slot
+	static bool compileRange(const QList<deviceChain> &chains, quint32 first, quint32 last, quint32 slot);
+private:
+	typedef struct {
+		quint32 first;
+		quint32 last;
+		bool error;
+	} stepRange;
+	static bool compileChain(deviceChain chain, quint32 first, quint32 last, quint32 slot);
+	static bool compileDevice(hardwareDevice *dev, quint32 first, quint32 last, quint32 slot);
+	static QVector<stepRange> splitSteps(quint32 first, quint32 last);
+};
+
+#endif // PLANCOMPILER_H
@@ -0,0 +1,152 @@
+/**
+ ******************************************************************************
+ *
+ * @file       main.cpp
+ * @author     Jose Barros (AKA PT_Dreamer) josemanuelbarros@gmail.com 2019
+ * @brief      planstream.cpp file
+ * @see        The GNU Public License (GPL) Version 3
+ * @defgroup   planStream
+ * @{
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+#include "planstream.h"
+#include "msa.h"
+#include "controllers/interface.h"
+#include <QtConcurrent>
+
+planStream::planStream(interface *owner):owner(owner), steps(0), chunks(0), streaming(false), pendingSegment(-1)
+{
+}
+
+planStream::~planStream()
+{
+	stop();
+}
+
+quint32 planStream::prepare(const QList<planCompiler::deviceChain> &chains, const msa::scanSnapshot &scan, chunkCallback callback)
+{
+	stop();
+	this->chains = chains;
+	this->callback = callback;
+	steps = scan->steps->size();
+	chunks = (steps + PLAN_STREAM_CHUNK - 1) / PLAN_STREAM_CHUNK;
+	streaming = isStreamed(steps);
+	segments.clear();
+	quint32 slots = steps;
+	if(streaming) {
+		segments.fill(-1, PLAN_STREAM_CHUNKS);
+		slots = PLAN_STREAM_CHUNK * PLAN_STREAM_CHUNKS;
+	}
+	planCompiler::prepare(chains, slots, scan);
+	return slots;
+}
+
+bool planStream::start(quint32 firstStep)
+{
+	if(!streaming) {
+		bool error = planCompiler::compileRange(chains, 0, steps, 0);
+		if(callback)
+			callback(0, steps);
+		return error;
+	}
+	if(firstStep >= steps)
+		firstStep = steps - 1;
+	quint32 chunk = firstStep / PLAN_STREAM_CHUNK;
+	segments[0] = chunk;
+	return compileChunk(chunk, 0, false);
+}
+
+quint32 planStream::slotOf(quint32 step, bool inverted)
+{
+	if(!streaming)
+		return step;
+	quint32 chunk = step / PLAN_STREAM_CHUNK;
+	int seg = findSegment(chunk);
+	if((seg < 0) || (seg == pendingSegment))
+		stop();
+	if(seg < 0) {
+		// out of order access (ex: single stepping backwards), compile it right away
+		seg = freeSegment(chunk, inverted);
+		segments[seg] = chunk;
+		compileChunk(chunk, seg, true);
+	}
+	prefetch(chunk, inverted);
+	return quint32(seg) * PLAN_STREAM_CHUNK + step % PLAN_STREAM_CHUNK;
+}
+
+void planStream::stop()
+{
+	if(pendingSegment < 0)
+		return;
+	pending.waitForFinished();
+	pendingSegment = -1;
+}
+
+bool planStream::compileChunk(quint32 chunk, int seg, bool report)
+{
+	quint32 first = chunk * PLAN_STREAM_CHUNK;
+	quint32 last = qMin(steps, first + PLAN_STREAM_CHUNK);
+	quint32 slot = quint32(seg) * PLAN_STREAM_CHUNK;
+	bool error = planCompiler::compileRange(chains, first, last, slot);
+	if(callback)
+		callback(slot, last - first);
+	// errors of the chunks compiled during the acquisition have no caller to return to
+	if(error && report)
+		owner->errorOcurred(msa::MSA, QString("Error ocurred processing steps %1 to %2").arg(first).arg(last - 1), true, true);
+	return error;
+}
+
+int planStream::findSegment(quint32 chunk) const
+{
+	return segments.indexOf(qint64(chunk));
+}
+
+quint32 planStream::distance(quint32 current, quint32 chunk, bool inverted) const
+{
+	if(inverted)
+		return (current + chunks - chunk) % chunks;
+	return (chunk + chunks - current) % chunks;
+}
+
+int planStream::freeSegment(quint32 current, bool inverted) const
+{
+	for(int x = 0; x < segments.size(); ++x) {
+		if((segments.at(x) < 0) || (distance(current, quint32(segments.at(x)), inverted) >= PLAN_STREAM_CHUNKS))
+			return x;
+	}
+	// the ring always holds fewer chunks ahead than it has segments, this is not reached
+	return (findSegment(current) + 1) % segments.size();
+}
+
+void planStream::prefetch(quint32 chunk, bool inverted)
+{
+	if(pendingSegment >= 0) {
+		if(!pending.isFinished())
+			return;
+		pendingSegment = -1;
+	}
+	for(quint32 ahead = 1; ahead < PLAN_STREAM_CHUNKS; ++ahead) {
+		quint32 next = inverted ? (chunk + chunks - ahead) % chunks : (chunk + ahead) % chunks;
+		if(findSegment(next) >= 0)
+			continue;
+		int seg = freeSegment(chunk, inverted);
+		segments[seg] = next;
+		pendingSegment = seg;
+		pending = QtConcurrent::run(this, &planStream::compileChunk, next, seg, true);
+		return;
+	}
+}
@@ -0,0 +1,89 @@
+/**
+ ******************************************************************************
+ *
+ * @file       main.cpp
+ * @author     Jose Barros (AKA PT_Dreamer) josemanuelbarros@gmail.com 2019
+ * @brief      planstream.h file
+ * @see        The GNU Public License (GPL) Version 3
+ * @defgroup   planStream
+ * @{
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef PLANSTREAM_H
+#define PLANSTREAM_H
+
+#include <QFuture>
+#include <QVector>
+#include <functional>
+#include "plancompiler.h"
+
+class interface;
+
+// steps compiled at once when streaming
+#define PLAN_STREAM_CHUNK 1024
+// chunks kept in the ring, the acquisition can be this many chunks minus one behind the compiler
+#define PLAN_STREAM_CHUNKS 4
+
+// Compiles the device plans of a scan into a bounded ring of step slots.
+// Scans that fit the ring are compiled entirely when started, slot == step.
+// Larger scans are compiled one chunk at a time in the background, ahead of
+// the step being acquired, so the device registers and frames are bounded
+// by the ring. The scanPlan (frequencies, LOs, calibration, settle times) is
+// still built and validated whole by msa::initScan(), a few doubles per step.
+// slotOf() must always be called from the same (acquisition) thread.
+class planStream
+{
+public:
+	// called after a chunk is compiled, from the compiling thread, with the slots it was stored to
+	typedef std::function<void(quint32 slot, quint32 count)> chunkCallback;
+	// errors of the chunks compiled in the background are reported to owner
+	planStream(interface *owner);
+	~planStream();
+	// allocates the device storage for a new scan and returns the number of slots,
+	// all its chunks are compiled from scan and its plan
+	quint32 prepare(const QList<planCompiler::deviceChain> &chains, const msa::scanSnapshot &scan, chunkCallback callback);
+	// compiles the whole scan, or only the chunk of firstStep when streaming, returns true on error
+	bool start(quint32 firstStep);
+	// slot holding step, the step is compiled if it is not in the ring yet
+	// and the chunks that follow in the scan direction are compiled in the background
+	quint32 slotOf(quint32 step, bool inverted);
+	bool isStreaming() const {return streaming;}
+	// a scan of steps doesn't fit the ring and would be streamed
+	static bool isStreamed(quint32 steps) {return steps > PLAN_STREAM_CHUNK * PLAN_STREAM_CHUNKS;}
+	// waits for the background compilation
+	void stop();
+private:
+	bool compileChunk(quint32 chunk, int seg, bool report);
+	int findSegment(quint32 chunk) const;
+	// number of chunks from current to chunk in the scan direction
+	quint32 distance(quint32 current, quint32 chunk, bool inverted) const;
+	// segment whose chunk is behind or too far ahead of current to be needed soon
+	int freeSegment(quint32 current, bool inverted) const;
+	void prefetch(quint32 chunk, bool inverted);
+	interface *owner;
+	QList<planCompiler::deviceChain> chains;
+	chunkCallback callback;
+	quint32 steps;
+	quint32 chunks;
+	bool streaming;
+	// chunk held by each ring segment, -1 if none
+	QVector<qint64> segments;
+	QFuture<bool> pending;
+	int pendingSegment;
+};
+
+#endif // PLANSTREAM_H
@@ -0,0 +1,188 @@
+/**
+ ******************************************************************************
+ *
+ * @file       main.cpp
+ * @author     Jose Barros (AKA PT_Dreamer) josemanuelbarros@gmail.com 2019
+ * @brief      planvalidator.cpp file
+ * @see        The GNU Public License (GPL) Version 3
+ * @defgroup   planValidator
+ * @{
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+#include "planvalidator.h"
+#include "scanplan.h"
+#include "frequencykernel.h"
+#include "lmx2326.h"
+#include <QStringList>
+#include <cmath>
+
+// steps checked per pass, sized for the stack buffers
+#define VALIDATION_CHUNK 256
+// step ranges listed per check in the report text
+#define MAX_LISTED_RANGES 5
+#define LO_MIN_MHZ 950
+#define LO_MAX_MHZ 2200
+
+static bool countersFailed(double ncounter)
+{
+	double Bcounter = floor(ncounter/32);
+	double Acounter = round(ncounter-(Bcounter*32));
+	return !lmx2326::checkNCounter(Acounter, Bcounter);
+}
+
+planValidator::report planValidator::validate(const msa::scanConfig &configuration, const scanPlan *plan, const QHash<msa::MSAdevice, hardwareDevice *> &devices)
+{
+	report r;
+	quint32 steps = plan->size();
+	if(steps == 0)
+		return r;
+	checkRun runs[CHECKS_NUMBER];
+	for(int x = 0; x < CHECKS_NUMBER; ++x)
+		runs[x].open = false;
+	genericPLL *pll1 = qobject_cast<genericPLL *>(devices.value(msa::PLL1));
+	genericPLL *pll3 = qobject_cast<genericPLL *>(devices.value(msa::PLL3));
+	bool lmx1 = qobject_cast<lmx2326 *>(pll1) != nullptr;
+	bool lmx3 = qobject_cast<lmx2326 *>(pll3) != nullptr;
+	// a forced DDS output is not checked against the filter, as before
+	bool dds1 = devices.contains(msa::DDS1) && !configuration.forcedDDS1.isForced;
+	bool dds3 = devices.contains(msa::DDS3) && !configuration.forcedDDS3.isForced;
+	double rcounter1 = pll1 ? pll1->getRCounter() : 1;
+	double rcounter3 = pll3 ? pll3->getRCounter() : 1;
+
+	// LO3 and everything derived from it is the same for all steps, only the generator scans use it
+	bool usesLO3 = (configuration.scanType == ComProtocol::SA_TG) || (configuration.scanType == ComProtocol::SA_SG);
+	if(pll3 && usesLO3) {
+		double LO3 = frequencyKernel::LO3(configuration);
+		double ncounter3, pfd3, ddsout3;
+		quint32 base3;
+		frequencyKernel::pllCounters(&LO3, configuration.appxdds3 / rcounter3, &ncounter3, &pfd3, 1);
+		frequencyKernel::ddsTuning(&pfd3, rcounter3, configuration.masterOscilatorFrequency, &base3, &ddsout3, 1);
+		track(r, runs, LO3_RANGE, 0, (LO3 > LO_MAX_MHZ) || (LO3 < LO_MIN_MHZ));
+		track(r, runs, PLL3_COUNTERS, 0, lmx3 && countersFailed(ncounter3));
+		track(r, runs, DDS3_FILTER, 0, dds3 && (qAbs(ddsout3 - configuration.appxdds3) > (configuration.dds3Filterbandwidth / 2)));
+	}
+	if(steps > 1) {
+		double stepSize = qAbs(plan->realFrequency.at(1) - plan->realFrequency.at(0));
+		track(r, runs, RBW_STEP, 0, stepSize > configuration.pathCalibration.bandwidth_MHZ);
+	}
+
+	if(pll1) {
+		double LO1[VALIDATION_CHUNK];
+		double ncounter[VALIDATION_CHUNK];
+		double pfd[VALIDATION_CHUNK];
+		double ddsout[VALIDATION_CHUNK];
+		quint32 base[VALIDATION_CHUNK];
+		for(quint32 first = 0; first < steps; first += VALIDATION_CHUNK) {
+			quint32 count = qMin(quint32(VALIDATION_CHUNK), steps - first);
+			frequencyKernel::LO1(plan->translatedFrequency.constData() + first, configuration.baseFrequency, configuration.LO2,
+								 configuration.pathCalibration.centerFreq_MHZ, LO1, count);
+			frequencyKernel::pllCounters(LO1, configuration.appxdds1 / rcounter1, ncounter, pfd, count);
+			if(dds1)
+				frequencyKernel::ddsTuning(pfd, rcounter1, configuration.masterOscilatorFrequency, base, ddsout, count);
+			for(quint32 i = 0; i < count; ++i) {
+				quint32 step = first + i;
+				track(r, runs, LO1_RANGE, step, (LO1[i] > LO_MAX_MHZ) || (LO1[i] < LO_MIN_MHZ));
+				track(r, runs, PLL1_COUNTERS, step, lmx1 && countersFailed(ncounter[i]));
+				track(r, runs, DDS1_FILTER, step, dds1 && (qAbs(ddsout[i] - configuration.appxdds1) > (configuration.dds1Filterbandwidth / 2)));
+			}
+		}
+	}
+	// the step independent checks cover the whole scan, the others end at the last step
+	for(int x = 0; x < CHECKS_NUMBER; ++x) {
+		if(!runs[x].open)
+			continue;
+		stepRange range;
+		range.check = checkType(x);
+		range.first = runs[x].first;
+		range.last = steps - 1;
+		r.ranges.append(range);
+		r.fatal |= isFatal(range.check);
+	}
+	return r;
+}
+
+void planValidator::track(report &r, checkRun *runs, checkType check, quint32 step, bool failed)
+{
+	checkRun &run = runs[check];
+	if(failed && !run.open) {
+		run.open = true;
+		run.first = step;
+	}
+	else if(!failed && run.open) {
+		run.open = false;
+		stepRange range;
+		range.check = check;
+		range.first = run.first;
+		range.last = step - 1;
+		r.ranges.append(range);
+		r.fatal |= isFatal(check);
+	}
+}
+
+QString planValidator::checkDescription(checkType check)
+{
+	switch (check) {
+	case LO1_RANGE:
+		return QString("LO1 outside %1-%2MHz").arg(LO_MIN_MHZ).arg(LO_MAX_MHZ);
+	case LO3_RANGE:
+		return QString("LO3 outside %1-%2MHz").arg(LO_MIN_MHZ).arg(LO_MAX_MHZ);
+	case PLL1_COUNTERS:
+		return "PLL1 A/B counters out of range";
+	case PLL3_COUNTERS:
+		return "PLL3 A/B counters out of range";
+	case DDS1_FILTER:
+		return "DDS1 output outside its output filter bandwidth";
+	case DDS3_FILTER:
+		return "DDS3 output outside its output filter bandwidth";
+	case RBW_STEP:
+		return "Frequency step size exceeds final filter bandwidth signals may be missed";
+	default:
+		return QString();
+	}
+}
+
+bool planValidator::isFatal(checkType check)
+{
+	return check != RBW_STEP;
+}
+
+QString planValidator::report::toString() const
+{
+	QStringList lines;
+	for(int c = 0; c < CHECKS_NUMBER; ++c) {
+		QStringList listed;
+		int total = 0;
+		foreach (stepRange range, ranges) {
+			if(range.check != c)
+				continue;
+			++total;
+			if(listed.size() == MAX_LISTED_RANGES)
+				continue;
+			if(range.first == range.last)
+				listed << QString::number(range.first);
+			else
+				listed << QString("%1-%2").arg(range.first).arg(range.last);
+		}
+		if(total == 0)
+			continue;
+		QString line = QString("%1 for steps %2").arg(checkDescription(checkType(c))).arg(listed.join(", "));
+		if(total > listed.size())
+			line.append(QString(" and %1 more ranges").arg(total - listed.size()));
+		lines << line;
+	}
+	return lines.join("\n");
+}
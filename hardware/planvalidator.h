@@ -0,0 +1,73 @@
+/**
+ ******************************************************************************
+ *
+ * @file       main.cpp
+ * @author     Jose Barros (AKA PT_Dreamer) josemanuelbarros@gmail.com 2019
+ * @brief      planvalidator.h file
+ * @see        The GNU Public License (GPL) Version 3
+ * @defgroup   planValidator
+ * @{
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef PLANVALIDATOR_H
+#define PLANVALIDATOR_H
+
+#include <QVector>
+#include <QString>
+#include "msa.h"
+
+// Checks a scan plan against the hardware limits before it is compiled.
+// Runs once per scan over the plan frequencies, with the same math as the
+// compilation, and collects the offending steps as ranges so a bad span
+// gives one report instead of one error per step.
+class planValidator
+{
+public:
+	typedef enum {LO1_RANGE, LO3_RANGE, PLL1_COUNTERS, PLL3_COUNTERS, DDS1_FILTER, DDS3_FILTER, RBW_STEP, CHECKS_NUMBER} checkType;
+	typedef struct {
+		checkType check;
+		quint32 first;
+		quint32 last;// inclusive
+	} stepRange;
+	class report
+	{
+	public:
+		report():fatal(false) {}
+		// the scan can't be run
+		bool isFatal() const {return fatal;}
+		bool isEmpty() const {return ranges.isEmpty();}
+		const QVector<stepRange> &getRanges() const {return ranges;}
+		// one line per failed check with its step ranges
+		QString toString() const;
+	private:
+		friend class planValidator;
+		QVector<stepRange> ranges;
+		bool fatal;
+	};
+	static report validate(const msa::scanConfig &configuration, const scanPlan *plan, const QHash<msa::MSAdevice, hardwareDevice *> &devices);
+private:
+	// keeps track of the step run currently failing a check
+	typedef struct {
+		bool open;
+		quint32 first;
+	} checkRun;
+	static void track(report &r, checkRun *runs, checkType check, quint32 step, bool failed);
+	static QString checkDescription(checkType check);
+	static bool isFatal(checkType check);
+};
+
+#endif // PLANVALIDATOR_H
@@ -0,0 +1,50 @@
+/**
+ ******************************************************************************
+ *
+ * @file       main.cpp
+ * @author     Jose Barros (AKA PT_Dreamer) josemanuelbarros@gmail.com 2019
+ * @brief      registerfield.h file
+ * @see        The GNU Public License (GPL) Version 3
+ * @defgroup   registerField
+ * @{
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef REGISTERFIELD_H
+#define REGISTERFIELD_H
+
+#include <QtGlobal>
+
+// Compile time description of a device register field.
+// Offset is the position of the least significant bit of the field, Bits its width.
+// Everything resolves to constant shifts and masks, there is no runtime field table.
+template<int Offset, int Bits>
+struct registerField
+{
+	static_assert(Offset >= 0 && Bits > 0 && Offset + Bits <= 64, "field does not fit in a 64 bit register");
+	// largest value the field can hold
+	static constexpr quint64 maximum() {return ~quint64(0) >> (64 - Bits);}
+	static constexpr quint64 mask() {return maximum() << Offset;}
+	// value positioned in the register, bits not fitting the field are dropped
+	static constexpr quint64 encode(quint64 value) {return (value & maximum()) << Offset;}
+	static constexpr quint64 set(quint64 reg, quint64 value) {return (reg & ~mask()) | encode(value);}
+	static constexpr quint32 get(quint64 reg) {return quint32((reg >> Offset) & maximum());}
+	static constexpr bool inRange(quint64 value) {return value <= maximum();}
+	// bit right after the field, used to print the field boundaries of a register
+	static constexpr quint64 end() {return quint64(2) << (Offset + Bits - 1);}
+};
+
+#endif // REGISTERFIELD_H
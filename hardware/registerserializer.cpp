@@ -0,0 +1,95 @@
+/**
+ ******************************************************************************
+ *
+ * @file       main.cpp
+ * @author     Jose Barros (AKA PT_Dreamer) josemanuelbarros@gmail.com 2019
+ * @brief      registerserializer.cpp file
+ * @see        The GNU Public License (GPL) Version 3
+ * @defgroup   registerSerializer
+ * @{
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+#include "registerserializer.h"
+#include <QtEndian>
+#include <QVarLengthArray>
+#include <string.h>
+
+static inline quint64 reverseBits(quint64 v)
+{
+	v = ((v >> 1) & 0x5555555555555555ULL) | ((v & 0x5555555555555555ULL) << 1);
+	v = ((v >> 2) & 0x3333333333333333ULL) | ((v & 0x3333333333333333ULL) << 2);
+	v = ((v >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((v & 0x0F0F0F0F0F0F0F0FULL) << 4);
+	return qbswap(v);
+}
+
+// spreads the 8 bits of x to bit 0 of 8 bytes, bit n going to byte n
+static inline quint64 spreadBits(quint64 x)
+{
+	quint64 t = ((x & 0xFF) * 0x0101010101010101ULL) & 0x8040201008040201ULL;
+	return ((t + 0x7F7F7F7F7F7F7F7FULL) & 0x8080808080808080ULL) >> 7;
+}
+
+registerSerializer::registerSerializer():bytes(0)
+{
+}
+
+void registerSerializer::addLine(const QVector<quint64> &registers, int size, hardwareDevice::bitOrder order, uint8_t pin)
+{
+	Q_ASSERT(size > 0 && size <= 64);
+	// one line per latch bit
+	Q_ASSERT(pin < 8);
+	Q_ASSERT(lines.size() < 8);
+	dataLine l;
+	l.registers = registers.constData();
+	l.size = size;
+	l.order = order;
+	l.pin = pin;
+	lines.append(l);
+	bytes = qMax(bytes, size);
+}
+
+void registerSerializer::clear()
+{
+	lines.clear();
+	bytes = 0;
+}
+
+void registerSerializer::serialize(quint32 slot, char *dest, uint8_t fixedBits) const
+{
+	// bit n of each stream is the value of the data line for output byte n,
+	// registers are right aligned in the frame so every line ends on the last byte
+	int count = lines.size();
+	QVarLengthArray<quint64, 8> streams(count);
+	for(int l = 0; l < count; ++l) {
+		const dataLine &line = lines.at(l);
+		quint64 reg = line.registers[slot];
+		if(line.size < 64)
+			reg &= (quint64(1) << line.size) - 1;
+		if(line.order == hardwareDevice::MSB_FIRST)
+			reg = reverseBits(reg) >> (64 - line.size);
+		streams[l] = reg << (bytes - line.size);
+	}
+	quint64 fixed = fixedBits * 0x0101010101010101ULL;
+	for(int b = 0; b < bytes; b += 8) {
+		quint64 word = fixed;
+		for(int l = 0; l < count; ++l)
+			word |= spreadBits(streams[l] >> b) << lines.at(l).pin;
+		uchar out[8];
+		qToLittleEndian(word, out);
+		memcpy(dest + b, out, size_t(qMin(8, bytes - b)));
+	}
+}
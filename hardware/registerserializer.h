@@ -0,0 +1,58 @@
+/**
+ ******************************************************************************
+ *
+ * @file       main.cpp
+ * @author     Jose Barros (AKA PT_Dreamer) josemanuelbarros@gmail.com 2019
+ * @brief      registerserializer.h file
+ * @see        The GNU Public License (GPL) Version 3
+ * @defgroup   registerSerializer
+ * @{
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef REGISTERSERIALIZER_H
+#define REGISTERSERIALIZER_H
+
+#include <QVector>
+#include "hardwaredevice.h"
+
+// Builds the latch byte stream of the scan steps from the packed device registers.
+// Each data line (PLL1, PLL2, PLL3, DDS1, DDS3 data pins) is a register per step
+// shifted out on one bit of the latch, all the lines are interleaved in one pass
+// with a 64 bit wide bit transpose, 8 output bytes at a time.
+class registerSerializer
+{
+public:
+	registerSerializer();
+	// registers must stay alive and unchanged while the serializer is used
+	void addLine(const QVector<quint64> &registers, int size, hardwareDevice::bitOrder order, uint8_t pin);
+	void clear();
+	// size in bytes of the stream of one step, the size of the largest register
+	int frameSize() const {return bytes;}
+	// writes frameSize() bytes of the register slot to dest, fixedBits is ORed into every byte
+	void serialize(quint32 slot, char *dest, uint8_t fixedBits) const;
+private:
+	typedef struct {
+		const quint64 *registers;
+		int size;
+		hardwareDevice::bitOrder order;
+		uint8_t pin;
+	} dataLine;
+	QVector<dataLine> lines;
+	int bytes;
+};
+
+#endif // REGISTERSERIALIZER_H
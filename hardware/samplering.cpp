@@ -0,0 +1,60 @@
+/**
+ ******************************************************************************
+ *
+ * @file       main.cpp
+ * @author     Jose Barros (AKA PT_Dreamer) josemanuelbarros@gmail.com 2019
+ * @brief      samplering.cpp file
+ * @see        The GNU Public License (GPL) Version 3
+ * @defgroup   sampleRing
+ * @{
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+#include "samplering.h"
+
+sampleRing::sampleRing():mask(SAMPLE_RING_SIZE - 1), head(0), tail(0), dropped(0)
+{
+	static_assert((SAMPLE_RING_SIZE & (SAMPLE_RING_SIZE - 1)) == 0, "the ring size must be a power of 2");
+	storage.resize(SAMPLE_RING_SIZE);
+	data = storage.data();
+}
+
+bool sampleRing::push(const sample &s)
+{
+	quint32 h = head.load(std::memory_order_relaxed);
+	if(h - tail.load(std::memory_order_acquire) > mask) {
+		dropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	data[h & mask] = s;
+	head.store(h + 1, std::memory_order_release);
+	return true;
+}
+
+quint32 sampleRing::drain(sample *dest, quint32 max)
+{
+	quint32 t = tail.load(std::memory_order_relaxed);
+	quint32 count = qMin(head.load(std::memory_order_acquire) - t, max);
+	for(quint32 x = 0; x < count; ++x)
+		dest[x] = data[(t + x) & mask];
+	tail.store(t + count, std::memory_order_release);
+	return count;
+}
+
+quint32 sampleRing::size() const
+{
+	return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+}
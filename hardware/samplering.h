@@ -0,0 +1,71 @@
+/**
+ ******************************************************************************
+ *
+ * @file       main.cpp
+ * @author     Jose Barros (AKA PT_Dreamer) josemanuelbarros@gmail.com 2019
+ * @brief      samplering.h file
+ * @see        The GNU Public License (GPL) Version 3
+ * @defgroup   sampleRing
+ * @{
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef SAMPLERING_H
+#define SAMPLERING_H
+
+#include <QtGlobal>
+#include <QVector>
+#include <atomic>
+
+// samples held by the ring, a power of 2
+#define SAMPLE_RING_SIZE 16384
+// samples taken at once by the consumers
+#define SAMPLE_RING_BATCH 256
+
+// Lock-free single producer, single consumer ring of the ADC samples.
+// The acquisition side pushes raw samples, the consumer drains them in
+// batches, nothing is allocated once the ring is created.
+// push() must always be called from the same thread, and so must drain().
+class sampleRing
+{
+public:
+	typedef struct {
+		quint32 step;
+		quint32 sweep; // sweep that acquired it, see interface::sweepSnapshot()
+		quint32 magnitude;
+		quint32 phase;
+		qint64 timestamp_ns; // monotonic, from the interface sample clock
+	} sample;
+	sampleRing();
+	// producer, false if the ring is full, the sample is then dropped
+	bool push(const sample &s);
+	// consumer, copies up to max of the oldest samples to dest and returns how many
+	quint32 drain(sample *dest, quint32 max);
+	// samples waiting, approximate when called from neither side
+	quint32 size() const;
+	// samples dropped because the consumer fell behind
+	quint32 getDropped() const {return dropped.load(std::memory_order_relaxed);}
+private:
+	QVector<sample> storage;
+	sample *data;
+	quint32 mask;
+	// each index is written by one side only, kept on separate cache lines
+	alignas(64) std::atomic<quint32> head;
+	alignas(64) std::atomic<quint32> tail;
+	std::atomic<quint32> dropped;
+};
+
+#endif // SAMPLERING_H
@@ -0,0 +1,101 @@
+/**
+ ******************************************************************************
+ *
+ * @file       main.cpp
+ * @author     Jose Barros (AKA PT_Dreamer) josemanuelbarros@gmail.com 2019
+ * @brief      scanplan.cpp file
+ * @see        The GNU Public License (GPL) Version 3
+ * @defgroup   scanPlan
+ * @{
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+#include "scanplan.h"
+
+scanPlan::scanPlan():stepsNumber(0)
+{
+}
+
+void scanPlan::allocate(quint32 steps)
+{
+	clear();
+	int s = int(steps);
+	realFrequency.resize(s);
+	translatedFrequency.resize(s);
+	LO1.fill(0, s);
+	LO3.fill(0, s);
+	band.resize(s);
+	frequencyCal.fill(0, s);
+	settle_us.fill(SETTLE_FULL, s);
+	stepsNumber = steps;
+}
+
+void scanPlan::clear()
+{
+	// resize(0) keeps the reserved capacity so the next scan of the same size does not reallocate
+	realFrequency.resize(0);
+	translatedFrequency.resize(0);
+	LO1.resize(0);
+	LO3.resize(0);
+	band.resize(0);
+	frequencyCal.resize(0);
+	settle_us.resize(0);
+	initSteps.clear();
+	stepsNumber = 0;
+}
+
+bool scanPlan::contains(quint32 step) const
+{
+	return isScanStep(step) || initSteps.contains(step);
+}
+
+msa::scanStep scanPlan::value(quint32 step) const
+{
+	if(!isScanStep(step))
+		return initSteps.value(step);
+	int i = int(step);
+	msa::scanStep s;
+	s.realFrequency = realFrequency.at(i);
+	s.translatedFrequency = translatedFrequency.at(i);
+	s.LO1 = LO1.at(i);
+	s.LO3 = LO3.at(i);
+	s.DDS1 = 0;
+	s.DDS2 = 0;
+	s.DDS3 = 0;
+	s.band = band.at(i);
+	s.frequencyCal = frequencyCal.at(i);
+	return s;
+}
+
+void scanPlan::setValue(quint32 step, const msa::scanStep &s)
+{
+	if(!isScanStep(step)) {
+		initSteps.insert(step, s);
+		return;
+	}
+	int i = int(step);
+	realFrequency[i] = s.realFrequency;
+	translatedFrequency[i] = s.translatedFrequency;
+	LO1[i] = s.LO1;
+	LO3[i] = s.LO3;
+	band[i] = s.band;
+	frequencyCal[i] = s.frequencyCal;
+}
+
+msa::scanStep &scanPlan::initStep(quint32 step)
+{
+	return initSteps[step];
+}
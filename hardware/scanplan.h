@@ -0,0 +1,68 @@
+/**
+ ******************************************************************************
+ *
+ * @file       main.cpp
+ * @author     Jose Barros (AKA PT_Dreamer) josemanuelbarros@gmail.com 2019
+ * @brief      scanplan.h file
+ * @see        The GNU Public License (GPL) Version 3
+ * @defgroup   scanPlan
+ * @{
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef SCANPLAN_H
+#define SCANPLAN_H
+
+#include <QVector>
+#include <QHash>
+#include "msa.h"
+
+// settle time of a step that must wait the whole write/read delay
+#define SETTLE_FULL 0xFFFFFFFF
+
+// Dense, index addressed storage for the steps of a scan.
+// Scan steps (0..size()-1) are kept as contiguous per field arrays, the
+// hardware init steps (HW_INIT_STEP and below) live in a small side table.
+class scanPlan
+{
+public:
+	scanPlan();
+	// allocates all per step arrays for a new scan, this is the only allocation done per scan
+	void allocate(quint32 steps);
+	void clear();
+	quint32 size() const {return stepsNumber;}
+	bool isScanStep(quint32 step) const {return step < stepsNumber;}
+	bool contains(quint32 step) const;
+	// gathers all fields of a step, works for scan and init steps
+	msa::scanStep value(quint32 step) const;
+	void setValue(quint32 step, const msa::scanStep &s);
+	// returns the init step, creating it if needed
+	msa::scanStep &initStep(quint32 step);
+
+	QVector<double> realFrequency;
+	QVector<double> translatedFrequency;
+	QVector<double> LO1;
+	QVector<double> LO3;
+	QVector<int> band;
+	QVector<double> frequencyCal;
+	// wait before the ADC read of each step, capped by the write/read delay when used
+	QVector<quint32> settle_us;
+	QHash<quint32, msa::scanStep> initSteps;
+private:
+	quint32 stepsNumber;
+};
+
+#endif // SCANPLAN_H
@@ -119,6 +119,9 @@ void hardwareConfigWidget::loadSavedSettings(bool loadDefaults)
 	appSettings.devices.insert(msa::ADC_MAG, hardwareDevice::HWdevice(settings->value("msa/hardwareTypes/ADC_MAG", static_cast <int>(hardwareDevice::AD7685)).toInt()));
 	appSettings.devices.insert(msa::ADC_PH, hardwareDevice::HWdevice(settings->value("msa/hardwareTypes/ADC_PH", static_cast <int>(hardwareDevice::AD7685)).toInt()));
 	appSettings.readWriteDelay = settings->value("msa/hardwareConfig/writeReadDelay_us", 1000).toUInt();
+	appSettings.usbWriteTimeout_ms = settings->value("msa/hardwareConfig/usbWriteTimeout_ms", 1000).toUInt();
+	appSettings.usbReadTimeout_ms = settings->value("msa/hardwareConfig/usbReadTimeout_ms", 1000).toUInt();
+	appSettings.stallTimeout_ms = settings->value("msa/hardwareConfig/stallTimeout_ms", 2000).toUInt();
 
 	config.PDMInversion_degrees = (settings->value("msa/hardwareConfig/PDMInversion_degrees", 180).toDouble());
 	config.PDMMaxOut = (settings->value("msa/hardwareConfig/PDMMaxOut", 65535).toUInt());
@@ -140,6 +143,14 @@ void hardwareConfigWidget::loadSavedSettings(bool loadDefaults)
 	config.PLL3pin14Output = settings->value("msa/hardwareConfig/PLL3pin14Output", 0).toUInt();
 	config.currentFinalFilterName = (settings->value("msa/hardwareConfig/finalFilterName", "DUMMY").toString());
 	config.currentVideoFilterName = (settings->value("msa/hardwareConfig/currentVideoFilterName", "").toString());
+	config.settling.adaptive = settings->value("msa/hardwareConfig/settling/adaptive", false).toBool();
+	config.settling.minimum_us = settings->value("msa/hardwareConfig/settling/minimum_us", 100).toDouble();
+	config.settling.PLL_us_per_MHz = settings->value("msa/hardwareConfig/settling/PLL_us_per_MHz", 10).toDouble();
+	config.sweepTime_ms = settings->value("msa/hardwareConfig/sweepTime_ms", 0).toDouble();
+	config.settling.closedLoop = settings->value("msa/hardwareConfig/settling/closedLoop", false).toBool();
+	config.settling.lockPort = settings->value("msa/hardwareConfig/settling/lockPort", 0).toInt();
+	config.settling.PLL1lockMask = uint8_t(settings->value("msa/hardwareConfig/settling/PLL1lockMask", 0).toUInt());
+	config.settling.PLL3lockMask = uint8_t(settings->value("msa/hardwareConfig/settling/PLL3lockMask", 0).toUInt());
 
 	config.scanType = ComProtocol::scanType_t(settings->value("app/lastValues/scanType", ComProtocol::SA_SG).toInt());
 	config.adcAveraging = uint8_t (settings->value("app/lastValues/adcAveraging", 2).toUInt());
@@ -220,6 +231,9 @@ void hardwareConfigWidget::saveSettings()
 	settings->setValue("msa/hardwareTypes/ADC_PH", appSettings.devices.value(msa::ADC_PH));
 
 	settings->setValue("msa/hardwareConfig/writeReadDelay_us", appSettings.readWriteDelay);
+	settings->setValue("msa/hardwareConfig/usbWriteTimeout_ms", appSettings.usbWriteTimeout_ms);
+	settings->setValue("msa/hardwareConfig/usbReadTimeout_ms", appSettings.usbReadTimeout_ms);
+	settings->setValue("msa/hardwareConfig/stallTimeout_ms", appSettings.stallTimeout_ms);
 
 	settings->setValue("msa/hardwareConfig/PDMInversion_degrees", config.PDMInversion_degrees);
 	settings->setValue("msa/hardwareConfig/PDMMaxOut", config.PDMMaxOut);
@@ -241,6 +255,14 @@ void hardwareConfigWidget::saveSettings()
 	settings->setValue("msa/hardwareConfig/PLL3pin14Output", config.PLL3pin14Output);
 	settings->setValue("msa/hardwareConfig/finalFilterName", config.currentFinalFilterName);
 	settings->setValue("msa/hardwareConfig/currentVideoFilterName", config.currentVideoFilterName);
+	settings->setValue("msa/hardwareConfig/settling/adaptive", config.settling.adaptive);
+	settings->setValue("msa/hardwareConfig/settling/minimum_us", config.settling.minimum_us);
+	settings->setValue("msa/hardwareConfig/settling/PLL_us_per_MHz", config.settling.PLL_us_per_MHz);
+	settings->setValue("msa/hardwareConfig/settling/closedLoop", config.settling.closedLoop);
+	settings->setValue("msa/hardwareConfig/sweepTime_ms", config.sweepTime_ms);
+	settings->setValue("msa/hardwareConfig/settling/lockPort", config.settling.lockPort);
+	settings->setValue("msa/hardwareConfig/settling/PLL1lockMask", config.settling.PLL1lockMask);
+	settings->setValue("msa/hardwareConfig/settling/PLL3lockMask", config.settling.PLL3lockMask);
 
 	qDebug() << "save" << config.pathCalibrationList.first().pathName;
 	m_calParser.saveCalDataToFile(config.pathCalibrationList, m_calParser.getConfigLocation() + QDir::separator() + STANDARD_PATHS_CAL_FILENAME);
@@ -746,6 +768,13 @@ void hardwareConfigWidget::loadCalibrationFiles()
 		f.dbm_val = 0;
 		config.pathCalibration.adcToMagCalFactors.insert(32767, f);
 	}
+	// the settling calibration is optional, when present it replaces the settling model settings
+	calParser::settlingCalData settling = m_calParser.loadSettlingCalDataFromFile(m_calParser.getConfigLocation() + QDir::separator() + STANDARD_SETTLING_CAL_FILENAME, s, err);
+	if(s) {
+		config.settling.adaptive = true;
+		config.settling.minimum_us = settling.minimum_us;
+		config.settling.PLL_us_per_MHz = settling.PLL_us_per_MHz;
+	}
 	if(config.pathCalibrationList.length() == 1) {
 		config.currentFinalFilterName = config.pathCalibrationList.first().pathName;
 		config.pathCalibration = config.pathCalibrationList.first();
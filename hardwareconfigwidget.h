@@ -46,6 +46,9 @@ public:
 		quint16 serverPort;
 		int debugLevel;
 		unsigned int readWriteDelay;
+		unsigned int usbWriteTimeout_ms; // 0 waits forever
+		unsigned int usbReadTimeout_ms;
+		unsigned int stallTimeout_ms; // 0 disables the acquisition watchdog
 		interface::interface_types currentInterfaceType;
 		QHash<msa::MSAdevice, hardwareDevice::HWdevice> devices;
 	}appSettings_t;
@@ -7,6 +7,7 @@
 #include "hardware/controllers/slimusb.h"
 #include "hardware/controllers/simulator.h"
 #include "hardware/msa.h"
+#include "hardware/scanplan.h"
 #include <QMessageBox>
 
 #ifndef QT_NO_SYSTEMTRAYICON
@@ -29,7 +30,7 @@
 #include <QDir>
 
 //! [0]
-MainWindow::MainWindow():hwInterface(nullptr), server(nullptr)
+MainWindow::MainWindow():hwInterface(nullptr), server(nullptr), processor(nullptr)
 {
 	logForm = new HelperForm();
 
@@ -229,6 +230,9 @@ void MainWindow::createActions()
 	showCalibrationAction = new QAction(tr("Show Ca&libration graphs"), this);
 	connect(showCalibrationAction, &QAction::triggered, this, &MainWindow::showCalibration);
 
+	calibrateSettlingAction = new QAction(tr("Calibrate &settling time"), this);
+	connect(calibrateSettlingAction, &QAction::triggered, this, &MainWindow::calibrateSettling);
+
 	minimizeAction = new QAction(tr("Mi&nimize"), this);
 	connect(minimizeAction, &QAction::triggered, this, &QWidget::hide);
 
@@ -248,6 +252,7 @@ void MainWindow::createTrayIcon()
 	trayIconMenu->addAction(showConfigAction);
 	trayIconMenu->addAction(showLogAction);
 	trayIconMenu->addAction(showCalibrationAction);
+	trayIconMenu->addAction(calibrateSettlingAction);
 	trayIconMenu->addSeparator();
 	trayIconMenu->addAction(minimizeAction);
 	trayIconMenu->addAction(maximizeAction);
@@ -271,13 +276,14 @@ MainWindow::MainWindow(QWidget *parent) :
 #endif
 void MainWindow::start() {
 	isConnected = false;
+	settlingRunning = false;
+	settlingStatusBack = interface::status_halted;
 	using namespace std::placeholders; // for `_1`
 
 	msa::getInstance().addScanConfigChangedCallback(std::bind(&MainWindow::msaScanConfigChanged, this, _1));
 
 	//msa::getInstance().addScanConfigChangedCallback(fnc_ptr);
 	msa::getInstance().setMainWindow(this);
-	msa::getInstance().currentScan.steps = new QHash<quint32, msa::scanStep>();
 	hardwareConfigWidget::appSettings_t appSettings = configurator->getAppSettings();
 	if(!server)
 		startServer(appSettings);
@@ -290,7 +296,7 @@ void MainWindow::start() {
 		on_Connect();
 }
 
-void MainWindow::msaScanConfigChanged(msa::scanConfig config)
+void MainWindow::msaScanConfigChanged(const msa::scanConfig &config)
 {
 	qDebug() << "scan config changed";
 	ComProtocol::msg_scan_config m_config;
@@ -305,7 +311,11 @@ MainWindow::~MainWindow()
 	delete ui;
 #endif
 	delete configurator;
-	delete msa::getInstance().currentScan.steps;
+	// the server and the processor are deleted when their thread finishes
+	if(processor)
+		processor->setInterface(nullptr);
+	processingThread.quit();
+	processingThread.wait();
 	logForm->deleteLater();
 }
 
@@ -313,26 +323,16 @@ void MainWindow::on_pushButton_clicked()
 {
 }
 
-void MainWindow::dataReady(quint32 step, quint32 mag, quint32 phase)
-{
-	if(msa::getInstance().currentInterface->getDebugLevel() > 2)
-		qDebug() << "received step:" << step << "MAG=" << mag << "PHASE=" << phase;
-	if(server->isConnected()) {
-        ComProtocol::msg_dual_dac dac;
-		dac.mag = msa::getInstance().currentScan.configuration.pathCalibration.adcToMagCalFactors.value(mag).dbm_val;
-		dac.phase = msa::getInstance().currentScan.configuration.pathCalibration.adcToMagCalFactors.value(mag).phase_val;
-		dac.mag += msa::getInstance().currentScan.configuration.frequencyCalibration.freqToPower.value(msa::getInstance().currentScan.steps->value(step).realFrequency);
-		dac.step = step;
-		QMutexLocker locker(&messageSend);
-        server->sendMessage(ComProtocol::DUAL_DAC, ComProtocol::MESSAGE_SEND, &dac);
-    }
-}
-
 void MainWindow::on_Connect()
 {
 	QMutexLocker locker(&mutex);
 	if(isConnected)
 		return;
+	// a connection that comes back keeps the devices and the compiled scan
+	if(hwInterface->resumeAfterReconnect()) {
+		isConnected = true;
+		return;
+	}
 	msa::scanConfig cfg;
 	cfg = msa::getInstance().getScanConfiguration();
 	msa::getInstance().hardwareInit(devices, hwInterface);
@@ -443,12 +443,65 @@ void MainWindow::showCalibration()
 #endif
 }
 
+void MainWindow::calibrateSettling()
+{
+	if(!hwInterface || !hwInterface->getIsConnected()) {
+		emit triggerMessage(WARNING, "Settling calibration", "The hardware is not connected", 5);
+		return;
+	}
+	if(settlingRunning)
+		return;
+	settlingStatusBack = hwInterface->getCurrentStatus();
+	hwInterface->setStatus(interface::status_paused);
+	// measured on the acquisition thread, settlingCalibrated() takes it from there
+	if(!hwInterface->calibrateSettling(SETTLE_CAL_TOLERANCE)) {
+		emit triggerMessage(WARNING, "Settling calibration", "The settling calibration could not be started", 5);
+		hwInterface->setStatus(settlingStatusBack);
+		return;
+	}
+	settlingRunning = true;
+}
+
+void MainWindow::settlingCalibrated(bool ok)
+{
+	if(!settlingRunning)
+		return;
+	settlingRunning = false;
+	if(!ok) {
+		emit triggerMessage(WARNING, "Settling calibration", "The settling time could not be measured", 5);
+		hwInterface->setStatus(settlingStatusBack);
+		return;
+	}
+	calParser::settlingCalData data = hwInterface->getSettlingCalibration();
+	calParser parser;
+	if(!parser.saveCalDataToFile(data, ""))
+		emit triggerMessage(WARNING, "Settling calibration", "Could not save the settling calibration file", 5);
+	else
+		emit triggerMessage(INFO, "Settling calibration", QString("%1us + %2us/MHz").arg(data.minimum_us).arg(data.PLL_us_per_MHz), 7);
+	msa::scanConfig config = configurator->getConfig();
+	config.settling.adaptive = true;
+	config.settling.minimum_us = data.minimum_us;
+	config.settling.PLL_us_per_MHz = data.PLL_us_per_MHz;
+	configurator->setConfig(config);
+	// the settle times of the plan come from the model
+	scanReinit();
+	hwInterface->setStatus(settlingStatusBack);
+}
+
 void MainWindow::startServer(hardwareConfigWidget::appSettings_t &appSettings)
 {
 	//DEBUG
-	server = new ComProtocol(this, appSettings.debugLevel);
+	server = new ComProtocol(nullptr, appSettings.debugLevel);
 	server->setServerPort(appSettings.serverPort);
-	if(!server->startServer())
+	processor = new sampleProcessor(server);
+	server->moveToThread(&processingThread);
+	processor->moveToThread(&processingThread);
+	connect(&processingThread, &QThread::finished, server, &QObject::deleteLater);
+	connect(&processingThread, &QThread::finished, processor, &QObject::deleteLater);
+	processingThread.start();
+	bool started = false;
+	QMetaObject::invokeMethod(server, [this]() {return server->startServer();}, Qt::BlockingQueuedConnection, &started);
+	if(!started)
 		emit triggerMessage(WARNING, "", QString("Socket server failed to start on port %1, Please fix the issue and restart the application").arg(appSettings.serverPort), 5);
 	connect(server, &ComProtocol::serverConnected, this, &MainWindow::newConnection, Qt::UniqueConnection);
 	connect(server, &ComProtocol::packetReceived, this, &MainWindow::onMessageReceivedServer, Qt::UniqueConnection);
@@ -457,20 +510,27 @@ void MainWindow::startServer(hardwareConfigWidget::appSettings_t &appSettings)
 
 void MainWindow::loadHardware(hardwareConfigWidget::appSettings_t &settings)
 {
-	if(hwInterface)
+	if(hwInterface) {
+		processor->setInterface(nullptr);
 		delete hwInterface;
+	}
 	if(settings.currentInterfaceType == interface::SIMULATOR)
 		hwInterface = new simulator(this);
 	else if (settings.currentInterfaceType == interface::USB) {
 		hwInterface = new slimusb(this);
 	}
+	else if (settings.currentInterfaceType == interface::EMULATOR)
+		hwInterface = new slimusb(this, true);
 	else {
 		qDebug() << settings.currentInterfaceType;
 		Q_ASSERT(false);
 	}
-	connect(hwInterface, SIGNAL(dataReady(quint32,quint32,quint32)), this, SLOT(dataReady(quint32, quint32, quint32)), Qt::UniqueConnection);
+	connect(hwInterface, &interface::samplesReady, processor, &sampleProcessor::samplesReady, Qt::UniqueConnection);
+	processor->setInterface(hwInterface);
 	connect(hwInterface, &interface::errorTriggered, this, &MainWindow::interfaceError, Qt::UniqueConnection);
+	connect(hwInterface, &interface::settlingCalibrated, this, &MainWindow::settlingCalibrated, Qt::UniqueConnection);
 	hwInterface->setWriteReadDelay_us(settings.readWriteDelay);
+	hwInterface->setTransferTimeouts(settings.usbWriteTimeout_ms, settings.usbReadTimeout_ms, settings.stallTimeout_ms);
 	devices.clear();
 	foreach (msa::MSAdevice dev, settings.devices.keys()) {
 		devices.insert(dev, settings.devices.value(dev));
@@ -9,6 +9,7 @@
 #include <QTcpSocket>
 #include <QMutexLocker>
 #include "shared/comprotocol.h"
+#include "sampleprocessor.h"
 #include "QSettings"
 #include "helperform.h"
 #include <QSystemTrayIcon>
@@ -95,6 +96,7 @@ private:
 	QAction *showLogAction;
 	QAction *showConfigAction;
 	QAction *showCalibrationAction;
+	QAction *calibrateSettlingAction;
 	QAction *maximizeAction;
 	QAction *restoreAction;
 	QAction *quitAction;
@@ -108,13 +110,14 @@ signals:
 	void triggerMessage(int type, QString title, QString text, int duration);
 private slots:
 	void on_pushButton_clicked();
-	void dataReady(quint32, quint32, quint32);
 	void on_Connect();
 	void on_Disconnect();
 	void newConnection();
 	void onMessageReceivedServer(ComProtocol::messageType, QByteArray);
 	void interfaceError(QString, bool, bool);
 	void showCalibration();
+	void calibrateSettling();
+	void settlingCalibrated(bool ok);
 	void scanReinit();
 	void hwReinit();
 	void trayIconTimerCallback();
@@ -130,15 +133,21 @@ private:
 	HelperForm *logForm;
 	QHash<msa::MSAdevice, int> devices;
 	interface *hwInterface;
+	// a settling calibration is running, the acquisition goes back to settlingStatusBack after it
+	bool settlingRunning;
+	interface::status settlingStatusBack;
 	QMutex mutex;
 	QMutex messageSend;
 	bool isConnected;
 
 	ComProtocol *server;
+	// converts and sends the samples, runs the server too
+	sampleProcessor *processor;
+	QThread processingThread;
 
 	hardwareConfigWidget *configurator;
 	void start();
-	void msaScanConfigChanged(msa::scanConfig config);
+	void msaScanConfigChanged(const msa::scanConfig &config);
 	QVector<trayMessages> trayMessagesList;
 	QTimer *trayIconTimer;
 };
@@ -0,0 +1,75 @@
+# the application but main.cpp, shared by openmsa.pro and the tests
+INCLUDEPATH += $$PWD
+
+SOURCES += $$PWD/mainwindow.cpp \
+    $$PWD/sampleprocessor.cpp \
+    $$PWD/hardware/lmx2326.cpp \
+    $$PWD/hardware/hardwaredevice.cpp \
+    $$PWD/hardware/deviceparser.cpp \
+    $$PWD/hardware/ad9850.cpp \
+    $$PWD/hardware/controllers/slimusb.cpp \
+    $$PWD/hardware/controllers/interface.cpp \
+    $$PWD/hardware/controllers/usbdevice.cpp \
+    $$PWD/hardware/controllers/simulator.cpp \
+    $$PWD/hardware/controllers/steppacer.cpp \
+    $$PWD/hardware/controllers/slimemulator.cpp \
+    $$PWD/hardware/genericadc.cpp \
+    $$PWD/hardware/msa.cpp \
+    $$PWD/hardware/scanplan.cpp \
+    $$PWD/hardware/plancompiler.cpp \
+    $$PWD/hardware/registerserializer.cpp \
+    $$PWD/hardware/frequencykernel.cpp \
+    $$PWD/hardware/planstream.cpp \
+    $$PWD/hardware/planvalidator.cpp \
+    $$PWD/hardware/samplering.cpp \
+    $$PWD/hardware/calibrationtable.cpp \
+    $$PWD/pathcalibrationwiz.cpp \
+    $$PWD/shared/comprotocol.cpp \
+    $$PWD/helperform.cpp \
+    $$PWD/calparser.cpp \
+    $$PWD/hardwareconfigwidget.cpp
+
+HEADERS  += $$PWD/mainwindow.h \
+    $$PWD/sampleprocessor.h \
+    $$PWD/hardware/lmx2326.h \
+    $$PWD/global_defs.h \
+    $$PWD/hardware/hardwaredevice.h \
+    $$PWD/hardware/deviceparser.h \
+    $$PWD/hardware/ad9850.h \
+    $$PWD/hardware/controllers/slimusb.h \
+    $$PWD/hardware/controllers/interface.h \
+    $$PWD/hardware/controllers/usbdevice.h \
+    $$PWD/hardware/controllers/simulator.h \
+    $$PWD/hardware/controllers/steppacer.h \
+    $$PWD/hardware/controllers/slimemulator.h \
+    $$PWD/hardware/genericadc.h \
+    $$PWD/hardware/msa.h \
+    $$PWD/hardware/scanplan.h \
+    $$PWD/hardware/plancompiler.h \
+    $$PWD/hardware/registerserializer.h \
+    $$PWD/hardware/registerfield.h \
+    $$PWD/hardware/frequencykernel.h \
+    $$PWD/hardware/planstream.h \
+    $$PWD/hardware/planvalidator.h \
+    $$PWD/hardware/samplering.h \
+    $$PWD/hardware/calibrationtable.h \
+    $$PWD/pathcalibrationwiz.h \
+    $$PWD/shared/comprotocol.h \
+    $$PWD/helperform.h \
+    $$PWD/calparser.h \
+    $$PWD/hardwareconfigwidget.h
+
+!contains(DEFINES, NO_CHARTS) {
+
+    SOURCES+=$$PWD/calibrationviewer.cpp
+    HEADERS+=$$PWD/calibrationviewer.h
+}
+
+FORMS   += $$PWD/mainwindow.ui \
+    $$PWD/helperform.ui \
+    $$PWD/calibrationviewer.ui \
+    $$PWD/hardwareconfigwidget.ui \
+    $$PWD/pathcalibration.ui
+LIBS	+= -L$$PWD/lib -lusb-1.0
+
+RESOURCES     = $$PWD/systray.qrc
@@ -11,6 +11,7 @@ target.path = /home/jose/code
 INSTALLS += target
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 QT +=network
+QT += concurrent
 QT += charts
 
 TARGET = openmsa
@@ -28,57 +29,13 @@ DEFINES += QT_DEPRECATED_WARNINGS
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 #DEFINES += QT_NO_SYSTEMTRAYICON
 #DEFINES += NO_CHARTS
-SOURCES += main.cpp\
-        mainwindow.cpp \
-    hardware/lmx2326.cpp \
-    hardware/hardwaredevice.cpp \
-    hardware/deviceparser.cpp \
-    hardware/ad9850.cpp \
-    hardware/controllers/slimusb.cpp \
-    hardware/controllers/interface.cpp \
-    hardware/controllers/usbdevice.cpp \
-    hardware/controllers/simulator.cpp \
-    hardware/genericadc.cpp \
-    hardware/msa.cpp \
-    pathcalibrationwiz.cpp \
-    shared/comprotocol.cpp \
-    helperform.cpp \
-    calparser.cpp \
-    hardwareconfigwidget.cpp
+# stores the expanded path calibration as 1/100 dB integers instead of floats
+#DEFINES += CALIBRATION_FIXED_POINT
+SOURCES += main.cpp
 
-HEADERS  += mainwindow.h \
-    hardware/lmx2326.h \
-    global_defs.h \
-    hardware/hardwaredevice.h \
-    hardware/deviceparser.h \
-    hardware/ad9850.h \
-    hardware/controllers/slimusb.h \
-    hardware/controllers/interface.h \
-    hardware/controllers/usbdevice.h \
-    hardware/controllers/simulator.h \
-    hardware/genericadc.h \
-    hardware/msa.h \
-    pathcalibrationwiz.h \
-    shared/comprotocol.h \
-    helperform.h \
-    calparser.h \
-    hardwareconfigwidget.h
-
-!contains(DEFINES, NO_CHARTS) {
-
-    SOURCES+=calibrationviewer.cpp
-    HEADERS+=calibrationviewer.h
-}
-
-FORMS   += mainwindow.ui \
-    helperform.ui \
-    calibrationviewer.ui \
-    hardwareconfigwidget.ui \
-    pathcalibration.ui
-LIBS	+= -L./lib -lusb-1.0
+# everything but main(), shared with the tests
+include(openmsa.pri)
 
 DISTFILES += \
     todo.txt \
     uncrustify.cfg
-
-RESOURCES     = systray.qrc
@@ -0,0 +1,79 @@
+/**
+ ******************************************************************************
+ *
+ * @file       main.cpp
+ * @author     Jose Barros (AKA PT_Dreamer) josemanuelbarros@gmail.com 2019
+ * @brief      sampleprocessor.cpp file
+ * @see        The GNU Public License (GPL) Version 3
+ * @defgroup   sampleProcessor
+ * @{
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+#include "sampleprocessor.h"
+#include <QDebug>
+
+sampleProcessor::sampleProcessor(ComProtocol *server):server(server), source(nullptr), snapshotSweep(0)
+{
+}
+
+void sampleProcessor::setInterface(interface *value)
+{
+	QMutexLocker locker(&sourceLock);
+	source = value;
+	// the sweep numbers belong to the interface
+	snapshotSweep = 0;
+	snapshot.clear();
+}
+
+void sampleProcessor::samplesReady()
+{
+	QMutexLocker locker(&sourceLock);
+	if(!source)
+		return;
+	bool debug = source->getDebugLevel() > 2;
+	sampleRing::sample batch[SAMPLE_RING_BATCH];
+	quint32 count;
+	while((count = source->takeSamples(batch, SAMPLE_RING_BATCH)) > 0) {
+		bool send = server->isConnected();
+		for(quint32 x = 0; x < count; ++x) {
+			if(debug)
+				qDebug() << "received step:" << batch[x].step << "MAG=" << batch[x].magnitude << "PHASE=" << batch[x].phase;
+			if(!send)
+				continue;
+			// each sample is converted with the configuration of the sweep that acquired it,
+			// the next scan may already be running
+			if(batch[x].sweep != snapshotSweep) {
+				snapshotSweep = batch[x].sweep;
+				snapshot = source->sweepSnapshot(snapshotSweep);
+			}
+			if(snapshot)
+				process(batch[x], *snapshot);
+		}
+	}
+}
+
+void sampleProcessor::process(const sampleRing::sample &s, const msa::scanSnapshotData &scan)
+{
+	const msa::scanConfig &configuration = scan.configuration;
+	ComProtocol::msg_dual_dac dac;
+	dac.mag = configuration.pathCalibrationTable.magnitude(s.magnitude);
+	dac.phase = configuration.pathCalibrationTable.phase(s.magnitude);
+	if(s.step < quint32(scan.frequencyCal.size()))
+		dac.mag += scan.frequencyCal.at(int(s.step));
+	dac.step = s.step;
+	server->sendMessage(ComProtocol::DUAL_DAC, ComProtocol::MESSAGE_SEND, &dac);
+}
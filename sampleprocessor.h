@@ -0,0 +1,58 @@
+/**
+ ******************************************************************************
+ *
+ * @file       main.cpp
+ * @author     Jose Barros (AKA PT_Dreamer) josemanuelbarros@gmail.com 2019
+ * @brief      sampleprocessor.h file
+ * @see        The GNU Public License (GPL) Version 3
+ * @defgroup   sampleProcessor
+ * @{
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+#ifndef SAMPLEPROCESSOR_H
+#define SAMPLEPROCESSOR_H
+
+#include <QObject>
+#include <QMutex>
+#include "hardware/controllers/interface.h"
+#include "shared/comprotocol.h"
+
+// Converts the acquired samples with the calibration of the current scan and
+// sends them to the client. Meant to live on its own thread, together with the
+// protocol, so the GUI events (dialogs, tray messages) don't hold back the data.
+class sampleProcessor : public QObject
+{
+	Q_OBJECT
+public:
+	sampleProcessor(ComProtocol *server);
+	// interface the samples are taken from, set to null before deleting it
+	void setInterface(interface *value);
+public slots:
+	// takes all the samples waiting in the interface
+	void samplesReady();
+private:
+	void process(const sampleRing::sample &s, const msa::scanSnapshotData &scan);
+	ComProtocol *server;
+	// held while the samples are taken, so the interface isn't deleted meanwhile
+	QMutex sourceLock;
+	interface *source;
+	// snapshot of the sweep of the last samples converted
+	quint32 snapshotSweep;
+	msa::scanSnapshot snapshot;
+};
+
+#endif // SAMPLEPROCESSOR_H
@@ -25,14 +25,19 @@
  */
 #include "comprotocol.h"
 #include <QDebug>
+#include <QThread>
 
 ComProtocol::ComProtocol(QObject *parent, int debugLevel) : QObject(parent),
 	server(nullptr),
 	serverPort(1234),
 	socket(nullptr),
 	bytesWaitingToBeSent(0),
+	clientReconnectTimer(this),
 	msgNumber(0),
-	debugLevel(debugLevel)
+	debugLevel(debugLevel),
+	currentStatus(LOOKING_FOR_SYNC),
+	currentType(DUAL_DAC),
+	currentCommandType(MESSAGE_REQUEST)
 {
 	messageSize.insert(DUAL_DAC, sizeof(msg_dual_dac));
 	messageSize.insert(PH_DAC, sizeof(msg_ph_dac));
@@ -45,6 +50,8 @@ ComProtocol::ComProtocol(QObject *parent, int debugLevel) : QObject(parent),
 	startOfData = 3 + sizeof(quint32);
 	messageSendBuffer.resize(int(max + startOfData + sizeof(quint16) + 2));
 	messageSendBuffer[0] = SYNC_BYTE;
+	// packetReceived is queued when the protocol runs on its own thread
+	qRegisterMetaType<ComProtocol::messageType>();
 
 	connect(&clientReconnectTimer, SIGNAL(timeout()), this, SLOT(connectToServer()));
 	connect(this, &ComProtocol::ackedReceived, this, &ComProtocol::handleAck);
@@ -121,6 +128,13 @@ void ComProtocol::handleAck(ComProtocol::messageType type, QByteArray data)
 
 void ComProtocol::sendMessage(messageType type, messageCommandType command, void *data)
 {
+	// the socket can only be written from the thread it lives in
+	if(QThread::currentThread() != thread()) {
+		int size = (command == messageCommandType::ACK) ? int(sizeof(quint32)) : int(messageSize.value(type));
+		QByteArray copy(static_cast<const char *>(data), size);
+		QMetaObject::invokeMethod(this, [this, type, command, copy]() mutable {sendMessage(type, command, copy.data());}, Qt::QueuedConnection);
+		return;
+	}
 	bytesWaitingToBeSentLock.lock();
 	quint32 msgNumber;
 	quint16 size = prepareMessage(type, command, data, msgNumber);
@@ -256,19 +270,12 @@ void ComProtocol::bytesWritten(qint64 count)
 
 void ComProtocol::processReceivedMessage()
 {
-	typedef enum {
-		LOOKING_FOR_SYNC, LOOKING_FOR_MSG_TYPE, LOOKING_FOR_COMMAND, LOOKING_FOR_MSG_CHECKSUM
-	}status;
-	static QByteArray receiveBuffer;
-	static status currentStatus = status::LOOKING_FOR_SYNC;
-	static messageType currentType;
-	static messageCommandType currentCommandType;
 	receiveBuffer.append(socket->readAll());
 	bool repeat = true;
 	while (repeat) {
 		repeat = false;
 		switch (currentStatus) {
-		case status::LOOKING_FOR_SYNC:
+		case LOOKING_FOR_SYNC:
 			if (debugLevel > 3)
 				qDebug() << "looking for synk";
 			if (receiveBuffer.contains(SYNC_BYTE)) {
@@ -279,7 +286,7 @@ void ComProtocol::processReceivedMessage()
 				currentStatus = LOOKING_FOR_MSG_TYPE;
 			}
 			break;
-		case status::LOOKING_FOR_MSG_TYPE:
+		case LOOKING_FOR_MSG_TYPE:
 			if (debugLevel > 3)
 				qDebug() << "looking for msg type";
 			if (receiveBuffer.length() > 2) {
@@ -294,7 +301,7 @@ void ComProtocol::processReceivedMessage()
 				}
 			}
 			break;
-		case status::LOOKING_FOR_COMMAND:
+		case LOOKING_FOR_COMMAND:
 			if (debugLevel > 3)
 				qDebug() << "looking for command";
 			if(receiveBuffer.length() > 3) {
@@ -303,7 +310,7 @@ void ComProtocol::processReceivedMessage()
 				repeat = true;
 			}
 			break;
-		case status::LOOKING_FOR_MSG_CHECKSUM:
+		case LOOKING_FOR_MSG_CHECKSUM:
 			quint32 msgSize = 0;
 			if(currentCommandType == messageCommandType::ACK) {
 				msgSize = sizeof (quint32);
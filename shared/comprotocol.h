@@ -106,6 +106,7 @@ public:
 	quint16 getServerPort() const;
 	void setServerPort(const quint16 &value);
 
+	// can be called from any thread, the message is queued to the protocol thread if needed
 	void sendMessage(messageType type, messageCommandType command, void *data);
 	QString getServerAddress() const;
 	void setServerAddress(const QString &value);
@@ -131,6 +132,14 @@ private:
 	QTimer clientReconnectTimer;
 	quint32 msgNumber;
 	int debugLevel;
+	// state of the received message parser, kept per connection
+	typedef enum {
+		LOOKING_FOR_SYNC, LOOKING_FOR_MSG_TYPE, LOOKING_FOR_COMMAND, LOOKING_FOR_MSG_CHECKSUM
+	} receiveStatus;
+	QByteArray receiveBuffer;
+	receiveStatus currentStatus;
+	messageType currentType;
+	messageCommandType currentCommandType;
 public slots:
 	bool connectToServer();
 	void handleAck(messageType, QByteArray);
@@ -142,4 +151,6 @@ private slots:
 	void retrySendMessage();
 };
 
+Q_DECLARE_METATYPE(ComProtocol::messageType)
+
 #endif // COMPROTOCOL_H
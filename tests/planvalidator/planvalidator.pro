@@ -0,0 +1,9 @@
+# checks of planValidator, run with make check
+QT       += core gui widgets network concurrent charts testlib
+CONFIG   += testcase
+TARGET = tst_planvalidator
+TEMPLATE = app
+
+include(../../openmsa.pri)
+
+SOURCES += tst_planvalidator.cpp
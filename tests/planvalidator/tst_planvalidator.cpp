@@ -0,0 +1,152 @@
+/**
+ ******************************************************************************
+ *
+ * @file       main.cpp
+ * @author     Jose Barros (AKA PT_Dreamer) josemanuelbarros@gmail.com 2019
+ * @brief      tst_planvalidator.cpp file
+ * @see        The GNU Public License (GPL) Version 3
+ * @defgroup   planValidatorTest
+ * @{
+ *
+ *****************************************************************************/
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License
+ * for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, see <http://www.gnu.org/licenses/>
+ */
+#include <QtTest>
+#include "hardware/planvalidator.h"
+#include "hardware/scanplan.h"
+#include "hardware/hardwaredevice.h"
+
+// R counter of the PLLs, what the lmx2326 gets from the default 10.7MHz/0.974MHz
+#define TEST_RCOUNTER 11
+
+// stands in for the configured PLLs and DDSs, the validator only needs their R counters
+class testPLL: public genericPLL
+{
+public:
+	testPLL():genericPLL(nullptr) {}
+	bool init() {return true;}
+	void reinit() {}
+	clockType getClk_type() const {return CLOCK_RISING_EDGE;}
+	int getRCounter() {return TEST_RCOUNTER;}
+};
+
+class testDDS: public genericDDS
+{
+public:
+	testDDS():genericDDS(nullptr) {}
+	bool init() {return true;}
+	void reinit() {}
+	clockType getClk_type() const {return CLOCK_RISING_EDGE;}
+};
+
+class planValidatorTest: public QObject
+{
+	Q_OBJECT
+public:
+	planValidatorTest();
+private slots:
+	void defaultScanPasses_data();
+	void defaultScanPasses();
+	void trackingGeneratorLO3Checked();
+private:
+	// the configuration the application starts with
+	msa::scanConfig defaultConfiguration() const;
+	// steps from start to end MHz, band 1
+	void fillPlan(scanPlan &plan, double start, double end, quint32 steps) const;
+	testPLL pll1;
+	testPLL pll3;
+	testDDS dds1;
+	testDDS dds3;
+	// PLL3 and DDS3 are always configured, as by hardwareConfigWidget
+	QHash<msa::MSAdevice, hardwareDevice *> devices;
+};
+
+planValidatorTest::planValidatorTest()
+{
+	devices.insert(msa::PLL1, &pll1);
+	devices.insert(msa::PLL3, &pll3);
+	devices.insert(msa::DDS1, &dds1);
+	devices.insert(msa::DDS3, &dds3);
+}
+
+msa::scanConfig planValidatorTest::defaultConfiguration() const
+{
+	msa::scanConfig configuration = msa::scanConfig();
+	configuration.LO2 = 1024;
+	configuration.appxdds1 = 10.7;
+	configuration.appxdds3 = 10.7;
+	configuration.dds1Filterbandwidth = 0.015;
+	configuration.dds3Filterbandwidth = 0.015;
+	configuration.PLL1phasefreq = 0.974;
+	configuration.PLL3phasefreq = 0.974;
+	configuration.masterOscilatorFrequency = 64;
+	configuration.baseFrequency = 0;
+	configuration.pathCalibration.centerFreq_MHZ = 10.7;
+	configuration.pathCalibration.bandwidth_MHZ = 1;
+	return configuration;
+}
+
+void planValidatorTest::fillPlan(scanPlan &plan, double start, double end, quint32 steps) const
+{
+	plan.allocate(steps);
+	for(quint32 x = 0; x < steps; ++x) {
+		double frequency = start + (end - start) * x / (steps - 1);
+		plan.realFrequency[int(x)] = frequency;
+		plan.translatedFrequency[int(x)] = frequency;
+		plan.band[int(x)] = 1;
+	}
+}
+
+void planValidatorTest::defaultScanPasses_data()
+{
+	QTest::addColumn<int>("scanType");
+	QTest::newRow("SA") << int(ComProtocol::SA);
+	QTest::newRow("VNA_Trans") << int(ComProtocol::VNA_Trans);
+	QTest::newRow("VNA_Rec") << int(ComProtocol::VNA_Rec);
+	QTest::newRow("SNA") << int(ComProtocol::SNA);
+	QTest::newRow("SA_TG") << int(ComProtocol::SA_TG);
+}
+
+void planValidatorTest::defaultScanPasses()
+{
+	QFETCH(int, scanType);
+	msa::scanConfig configuration = defaultConfiguration();
+	configuration.scanType = ComProtocol::scanType_t(scanType);
+	scanPlan plan;
+	fillPlan(plan, 0, 100, 1001);
+	planValidator::report r = planValidator::validate(configuration, &plan, devices);
+	QVERIFY2(r.isEmpty(), qPrintable(r.toString()));
+	QVERIFY(!r.isFatal());
+}
+
+void planValidatorTest::trackingGeneratorLO3Checked()
+{
+	msa::scanConfig configuration = defaultConfiguration();
+	configuration.scanType = ComProtocol::SA_TG;
+	// LO3 = LO2 - IF - offset, well below the PLL range
+	configuration.gui.TGoffset = 500;
+	scanPlan plan;
+	fillPlan(plan, 0, 100, 1001);
+	planValidator::report r = planValidator::validate(configuration, &plan, devices);
+	QVERIFY(r.isFatal());
+	bool found = false;
+	foreach (planValidator::stepRange range, r.getRanges())
+		found |= range.check == planValidator::LO3_RANGE;
+	QVERIFY(found);
+}
+
+QTEST_MAIN(planValidatorTest)
+
+#include "tst_planvalidator.moc"